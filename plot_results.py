@@ -11,10 +11,11 @@ def read_outfile(outfile):
     metric_values = []
     for line in outfile:
         if "=" in line:
-            key, value = line.split("=")
-            props[key] = int(value)
+            key, value = line.strip().split("=")
+            props[key] = int(value) if value.isdigit() else value.split()
         else:
-            metric_values.append(float(line))
+            # first column is the metric, the others are throughput stats
+            metric_values.append(float(line.split()[0]))
     return props, metric_values
 
 def plot_metric_values(metric_values):
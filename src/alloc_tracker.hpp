@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Opt-in allocation profiler.
+ *
+ * With BDAP_TRACK_ALLOCS=1 (CMake option), the global `operator new` and
+ * `operator delete` are replaced by versions that count allocations and bytes
+ * per thread, and track the live and peak heap size of the process. Exactly
+ * one translation unit per executable must define BDAP_ALLOC_TRACKER_IMPL
+ * before including this header to emit the replacement operators.
+ *
+ * Over-aligned allocations (`operator new(size_t, align_val_t)`) are not
+ * tracked.
+ */
+#ifndef BDAP_TRACK_ALLOCS
+#define BDAP_TRACK_ALLOCS 0
+#endif
+
+namespace bdap {
+
+struct AllocStats {
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0; // allocated bytes
+
+    AllocStats& operator-=(const AllocStats& o) {
+        allocs -= o.allocs;
+        frees -= o.frees;
+        bytes -= o.bytes;
+        return *this;
+    }
+
+    AllocStats& operator+=(const AllocStats& o) {
+        allocs += o.allocs;
+        frees += o.frees;
+        bytes += o.bytes;
+        return *this;
+    }
+};
+
+/** Allocations made by the calling thread. */
+inline AllocStats& thread_alloc_stats() {
+    thread_local AllocStats stats;
+    return stats;
+}
+
+inline std::atomic<int64_t>& live_heap_bytes() {
+    static std::atomic<int64_t> live{0};
+    return live;
+}
+
+inline std::atomic<int64_t>& peak_heap_bytes() {
+    static std::atomic<int64_t> peak{0};
+    return peak;
+}
+
+namespace detail {
+
+// Prefix every block with its size, keeping the default new alignment.
+constexpr size_t ALLOC_HEADER = alignof(std::max_align_t) < 16
+    ? 16 : alignof(std::max_align_t);
+
+inline void *tracked_alloc(size_t size) {
+    void *p = std::malloc(size + ALLOC_HEADER);
+    if (!p)
+        return nullptr;
+    *static_cast<size_t *>(p) = size;
+
+    AllocStats& stats = thread_alloc_stats();
+    ++stats.allocs;
+    stats.bytes += size;
+    int64_t live = live_heap_bytes().fetch_add(size, std::memory_order_relaxed)
+        + static_cast<int64_t>(size);
+    int64_t peak = peak_heap_bytes().load(std::memory_order_relaxed);
+    while (live > peak && !peak_heap_bytes().compare_exchange_weak(
+                peak, live, std::memory_order_relaxed)) {}
+
+    return static_cast<char *>(p) + ALLOC_HEADER;
+}
+
+inline void tracked_free(void *p) {
+    if (!p)
+        return;
+    void *block = static_cast<char *>(p) - ALLOC_HEADER;
+    size_t size = *static_cast<size_t *>(block);
+    ++thread_alloc_stats().frees;
+    live_heap_bytes().fetch_sub(size, std::memory_order_relaxed);
+    std::free(block);
+}
+
+} // namespace detail
+
+/** Resident set size of the process in bytes (0 if unknown). */
+inline uint64_t current_rss_bytes() {
+#if defined(__linux__)
+    long pages_total = 0, pages_resident = 0;
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    int n = std::fscanf(f, "%ld %ld", &pages_total, &pages_resident);
+    std::fclose(f);
+    if (n != 2)
+        return 0;
+    return static_cast<uint64_t>(pages_resident) * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+/** Peak resident set size of the process in bytes (0 if unknown). */
+inline uint64_t peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+} // namespace bdap
+
+#if BDAP_TRACK_ALLOCS && defined(BDAP_ALLOC_TRACKER_IMPL)
+
+void *operator new(std::size_t size) {
+    void *p = bdap::detail::tracked_alloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](std::size_t size) {
+    void *p = bdap::detail::tracked_alloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{ return bdap::detail::tracked_alloc(size); }
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{ return bdap::detail::tracked_alloc(size); }
+
+void operator delete(void *p) noexcept { bdap::detail::tracked_free(p); }
+void operator delete[](void *p) noexcept { bdap::detail::tracked_free(p); }
+void operator delete(void *p, std::size_t) noexcept { bdap::detail::tracked_free(p); }
+void operator delete[](void *p, std::size_t) noexcept { bdap::detail::tracked_free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{ bdap::detail::tracked_free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{ bdap::detail::tracked_free(p); }
+
+#endif // BDAP_TRACK_ALLOCS && BDAP_ALLOC_TRACKER_IMPL
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "email.hpp"
+#include "hashed_email.hpp"
+#include "naive_bayes_feature_hashing.hpp"
+#include "perceptron_feature_hashing.hpp"
+#include "naive_bayes_count_min.hpp"
+#include "perceptron_count_min.hpp"
+
+namespace bdap {
+
+enum class ClfType {
+    NaiveBayesFeatureHashing,
+    NaiveBayesCountMin,
+    PerceptronFeatureHashing,
+    PerceptronCountMin,
+};
+
+/**
+ * Type and hyperparameters of a classifier, chosen at run time.
+ *
+ * The string form mirrors the constructor arguments of each classifier:
+ *
+ *  - `nbfh:<ngram>:<log_num_buckets>`
+ *  - `nbcm:<ngram>:<num_hashes>:<log_num_buckets>`
+ *  - `pfh:<ngram>:<log_num_buckets>:<learning_rate>`
+ *  - `pcm:<ngram>:<num_hashes>:<log_num_buckets>:<learning_rate>`
+ */
+struct ClfConfig {
+    ClfType type = ClfType::NaiveBayesFeatureHashing;
+    int ngram = 1;
+    int num_hashes = 1;
+    int log_num_buckets = 10;
+    double learning_rate = 0.0;
+
+    /** `nbfh`, `nbcm`, `pfh` or `pcm`. */
+    static ClfType parse_type(const std::string& name) {
+        if (name == "nbfh") return ClfType::NaiveBayesFeatureHashing;
+        if (name == "nbcm") return ClfType::NaiveBayesCountMin;
+        if (name == "pfh") return ClfType::PerceptronFeatureHashing;
+        if (name == "pcm") return ClfType::PerceptronCountMin;
+        throw std::invalid_argument("invalid classifier type `" + name + "`");
+    }
+
+    static ClfConfig parse(const std::string& spec) {
+        std::vector<std::string> parts;
+        std::stringstream ss(spec);
+        std::string part;
+        while (std::getline(ss, part, ':'))
+            parts.push_back(part);
+
+        ClfConfig c;
+        size_t expected = 0;
+        try {
+            if (parts.size() > 0 && parts[0] == "nbfh") {
+                c.type = ClfType::NaiveBayesFeatureHashing;
+                expected = 3;
+                if (parts.size() == expected) {
+                    c.ngram = std::stoi(parts[1]);
+                    c.log_num_buckets = std::stoi(parts[2]);
+                }
+            } else if (parts.size() > 0 && parts[0] == "nbcm") {
+                c.type = ClfType::NaiveBayesCountMin;
+                expected = 4;
+                if (parts.size() == expected) {
+                    c.ngram = std::stoi(parts[1]);
+                    c.num_hashes = std::stoi(parts[2]);
+                    c.log_num_buckets = std::stoi(parts[3]);
+                }
+            } else if (parts.size() > 0 && parts[0] == "pfh") {
+                c.type = ClfType::PerceptronFeatureHashing;
+                expected = 4;
+                if (parts.size() == expected) {
+                    c.ngram = std::stoi(parts[1]);
+                    c.log_num_buckets = std::stoi(parts[2]);
+                    c.learning_rate = std::stod(parts[3]);
+                }
+            } else if (parts.size() > 0 && parts[0] == "pcm") {
+                c.type = ClfType::PerceptronCountMin;
+                expected = 5;
+                if (parts.size() == expected) {
+                    c.ngram = std::stoi(parts[1]);
+                    c.num_hashes = std::stoi(parts[2]);
+                    c.log_num_buckets = std::stoi(parts[3]);
+                    c.learning_rate = std::stod(parts[4]);
+                }
+            }
+        } catch (const std::exception&) {
+            expected = 0;
+        }
+        if (expected == 0 || parts.size() != expected || c.ngram <= 0
+                || c.num_hashes <= 0 || c.log_num_buckets < 0)
+            throw std::invalid_argument("invalid classifier spec `" + spec + "`");
+        return c;
+    }
+
+    /** Inverse of `parse`. */
+    std::string name() const {
+        std::stringstream ss;
+        switch (type) {
+        case ClfType::NaiveBayesFeatureHashing:
+            ss << "nbfh:" << ngram << ':' << log_num_buckets;
+            break;
+        case ClfType::NaiveBayesCountMin:
+            ss << "nbcm:" << ngram << ':' << num_hashes << ':' << log_num_buckets;
+            break;
+        case ClfType::PerceptronFeatureHashing:
+            ss << "pfh:" << ngram << ':' << log_num_buckets << ':' << learning_rate;
+            break;
+        case ClfType::PerceptronCountMin:
+            ss << "pcm:" << ngram << ':' << num_hashes << ':' << log_num_buckets
+               << ':' << learning_rate;
+            break;
+        }
+        return ss.str();
+    }
+};
+
+/**
+ * Any of the classifiers, chosen at run time from a `ClfConfig`. Calls are
+ * dispatched once per email, so the per n-gram loops stay monomorphic.
+ */
+class AnyClf {
+    using Variant = std::variant<NaiveBayesFeatureHashing, NaiveBayesCountMin,
+                                 PerceptronFeatureHashing, PerceptronCountMin>;
+    ClfConfig config_;
+    Variant clf_;
+
+public:
+    /** All classifiers hash n-grams with the same hash policy, so that they
+     * can share `HashedEmail`s hashed with this one. */
+    using Hasher = NaiveBayesFeatureHashing;
+    static_assert(NaiveBayesCountMin::hash_kind == Hasher::hash_kind
+                  && PerceptronFeatureHashing::hash_kind == Hasher::hash_kind
+                  && PerceptronCountMin::hash_kind == Hasher::hash_kind,
+                  "the classifiers of AnyClf must share their hash policy");
+
+    explicit AnyClf(const ClfConfig& config)
+        : config_(config), clf_(make(config)) {}
+
+    /** Read a snapshot written by `save` into a classifier that can be
+     * trained further, with `learning_rate` for the perceptrons. */
+    static AnyClf load(std::istream& is, double learning_rate = 0.0) {
+        SnapshotHeader header = read_snapshot_header(is);
+        ClfConfig c;
+        c.ngram = header.ngram;
+        c.num_hashes = header.num_hashes;
+        c.log_num_buckets = header.log_num_buckets;
+        c.learning_rate = learning_rate;
+        switch (header.kind) {
+        case ModelKind::NaiveBayesFeatureHashing:
+            c.type = ClfType::NaiveBayesFeatureHashing;
+            return AnyClf(c, NaiveBayesFeatureHashing::load(header, is));
+        case ModelKind::NaiveBayesCountMin:
+            c.type = ClfType::NaiveBayesCountMin;
+            return AnyClf(c, NaiveBayesCountMin::load(header, is));
+        case ModelKind::PerceptronFeatureHashing:
+            c.type = ClfType::PerceptronFeatureHashing;
+            return AnyClf(c, PerceptronFeatureHashing::load(header, is,
+                                                            learning_rate));
+        case ModelKind::PerceptronCountMin:
+            c.type = ClfType::PerceptronCountMin;
+            return AnyClf(c, PerceptronCountMin::load(header, is,
+                                                      learning_rate));
+        case ModelKind::SparseFeatureHashing:
+            throw std::runtime_error("sparse models are read-only, use SparseModel");
+        }
+        throw std::runtime_error("invalid snapshot model kind");
+    }
+
+    const ClfConfig& config() const { return config_; }
+
+    template <typename E> // Email or HashedEmail
+    void update(const E& email)
+    { std::visit([&](auto& clf) { clf.update(email); }, clf_); }
+
+    template <typename E>
+    double predict(const E& email) const
+    { return std::visit([&](const auto& clf) { return clf.predict(email); }, clf_); }
+
+    bool classify(double pr) const
+    { return std::visit([&](const auto& clf) { return clf.classify(pr); }, clf_); }
+
+    template <typename E>
+    bool classify(const E& email) const { return classify(predict(email)); }
+
+    int ngram() const { return config_.ngram; }
+
+    int num_examples_processed() const {
+        return std::visit([](const auto& clf) {
+            return clf.num_examples_processed; }, clf_);
+    }
+
+    size_t memory_bytes() const
+    { return std::visit([](const auto& clf) { return clf.memory_bytes(); }, clf_); }
+
+    void require_hashes(HashSpec& spec) const
+    { std::visit([&](const auto& clf) { clf.require_hashes(spec); }, clf_); }
+
+    /** See `NaiveBayesFeatureHashing::use_anytime_predict` and friends. */
+    void use_anytime_predict(size_t max_ngrams = 0)
+    { std::visit([&](auto& clf) { clf.use_anytime_predict(max_ngrams); }, clf_); }
+
+    /** See `PerceptronFeatureHashing::use_margin_updates`; only for the
+     * perceptrons. */
+    void use_margin_updates(double margin, double aggressiveness = 0.0) {
+        std::visit([&](auto& clf) {
+            using Clf = std::decay_t<decltype(clf)>;
+            if constexpr (std::is_same_v<Clf, PerceptronFeatureHashing>
+                    || std::is_same_v<Clf, PerceptronCountMin>)
+                clf.use_margin_updates(margin, aggressiveness);
+            else
+                throw std::logic_error("margin updates need a perceptron");
+        }, clf_);
+    }
+
+    /** Number of updates skipped by margin updates (0 for Naive Bayes). */
+    uint64_t num_skipped_updates() const {
+        return std::visit([](const auto& clf) -> uint64_t {
+            using Clf = std::decay_t<decltype(clf)>;
+            if constexpr (std::is_same_v<Clf, PerceptronFeatureHashing>
+                    || std::is_same_v<Clf, PerceptronCountMin>)
+                return clf.num_skipped_updates();
+            else
+                return 0;
+        }, clf_);
+    }
+
+    void save(std::ostream& os) const
+    { std::visit([&](const auto& clf) { clf.save(os); }, clf_); }
+
+    /** The underlying classifier, e.g., `get<PerceptronCountMin>()`. */
+    template <typename Clf> Clf& get() { return std::get<Clf>(clf_); }
+    template <typename Clf> const Clf& get() const { return std::get<Clf>(clf_); }
+
+private:
+    template <typename Clf>
+    AnyClf(const ClfConfig& config, Clf&& clf)
+        : config_(config), clf_(std::forward<Clf>(clf)) {}
+
+    static Variant make(const ClfConfig& c) {
+        switch (c.type) {
+        case ClfType::NaiveBayesFeatureHashing:
+            return Variant(std::in_place_type<NaiveBayesFeatureHashing>,
+                           c.ngram, c.log_num_buckets);
+        case ClfType::NaiveBayesCountMin:
+            return Variant(std::in_place_type<NaiveBayesCountMin>,
+                           c.ngram, c.num_hashes, c.log_num_buckets);
+        case ClfType::PerceptronFeatureHashing:
+            return Variant(std::in_place_type<PerceptronFeatureHashing>,
+                           c.ngram, c.log_num_buckets, c.learning_rate);
+        case ClfType::PerceptronCountMin:
+            return Variant(std::in_place_type<PerceptronCountMin>,
+                           c.ngram, c.num_hashes, c.log_num_buckets,
+                           c.learning_rate);
+        }
+        throw std::invalid_argument("invalid classifier type");
+    }
+};
+
+} // namespace bdap
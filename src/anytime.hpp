@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bdap {
+
+/**
+ * Anytime prediction: stop summing the per n-gram contributions of an email
+ * as soon as the hard classification can no longer change, or when a budget
+ * of n-grams is spent.
+ *
+ * All four classifiers classify by comparing a sum of per n-gram terms to a
+ * cut (the log odds of the Naive Bayes models to 0, the activation of the
+ * perceptrons to 0). Each classifier keeps bounds `lo <= term <= hi` that
+ * hold for every n-gram, derived from the largest entries of its tables.
+ * With `r` n-grams left, once `sum + r * lo > cut` the email is spam whatever
+ * the remaining n-grams are, and once `sum + r * hi <= cut` it is ham. Such
+ * a bound exit gives the same hard label as the full sum; its soft label is
+ * the partial sum. A budget exit gives a best-effort label from the first
+ * `max_ngrams` n-grams.
+ */
+struct AnytimePredict {
+    bool enabled = false;
+    size_t max_ngrams = 0; // 0: no budget, only exit on the bounds
+};
+
+/** Counts of the anytime predictions of the calling thread. */
+struct EarlyExitStats {
+    uint64_t num_predictions = 0;
+    uint64_t num_bound_exits = 0;
+    uint64_t num_budget_exits = 0;
+    uint64_t num_ngrams = 0;        // n-grams of the emails
+    uint64_t num_ngrams_scored = 0; // n-grams actually looked at
+
+    double exit_fraction() const {
+        return num_predictions
+            ? double(num_bound_exits + num_budget_exits) / num_predictions : 0.0;
+    }
+
+    double scored_fraction() const
+    { return num_ngrams ? double(num_ngrams_scored) / num_ngrams : 1.0; }
+};
+
+inline EarlyExitStats& early_exit_stats() {
+    thread_local EarlyExitStats stats;
+    return stats;
+}
+
+/**
+ * Add `term(ngrams)` to `sum` for the n-grams of the cursor `ngrams` (after
+ * `next()`), until the classification is decided (see `AnytimePredict`) or
+ * the budget is spent.
+ */
+template <typename Ngrams, typename Term>
+double anytime_sum(Ngrams ngrams, double sum, double cut, double lo, double hi,
+                   const AnytimePredict& config, Term&& term) {
+    EarlyExitStats& stats = early_exit_stats();
+    ++stats.num_predictions;
+    size_t remaining = ngrams.remaining();
+    stats.num_ngrams += remaining;
+    size_t scored = 0;
+    while (remaining > 0) {
+        if (sum + remaining * lo > cut || sum + remaining * hi <= cut) {
+            ++stats.num_bound_exits;
+            break;
+        }
+        if (scored == config.max_ngrams && config.max_ngrams > 0) {
+            ++stats.num_budget_exits;
+            break;
+        }
+        ngrams.next();
+        sum += term(ngrams);
+        --remaining;
+        ++scored;
+    }
+    stats.num_ngrams_scored += scored;
+    return sum;
+}
+
+} // namespace bdap
@@ -0,0 +1,649 @@
+/*
+ * Microbenchmarks for the hot kernels: hashing, tokenization, n-gram
+ * generation, and `update`/`predict` of every classifier.
+ *
+ * Usage: ./bdap_bench [<output-json>] [<name-filter>]
+ *
+ * Results are written as a JSON array to the output file (stdout if omitted
+ * or `-`). Only benchmarks whose name contains the filter are run.
+ *
+ * It first checks the hash functions against reference values, and the SIMD
+ * MurmurHash3 kernels against the scalar one, since stored models depend on
+ * them, and exits with status 5 if one differs.
+ */
+
+#define BDAP_ALLOC_TRACKER_IMPL // this TU defines the tracking operator new
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "corpus_gen.hpp"
+#include "email.hpp"
+#include "base_classifier.hpp"
+#include "concurrent_model.hpp"
+#include "near_duplicate.hpp"
+#include "prediction_cache.hpp"
+
+#include "naive_bayes_feature_hashing.hpp"
+#include "perceptron_feature_hashing.hpp"
+#include "naive_bayes_count_min.hpp"
+#include "perceptron_count_min.hpp"
+#include "ftrl_feature_hashing.hpp"
+#include "sparse_model.hpp"
+
+using namespace bdap;
+
+using Params = std::vector<std::pair<std::string, double>>;
+
+static double total_bytes(const std::vector<Email>& emails) {
+    double bytes = 0.0;
+    for (const Email& email : emails)
+        bytes += email.body().size();
+    return bytes;
+}
+
+/** Compare `wyhash` and `XXH3_64bits_withSeed` with reference values:
+ * the published wyhash (final version 4) test vectors, and XXH3 from the
+ * reference implementation, on prefixes of "abc...zabc..." that cover each
+ * of its length paths. */
+static bool check_hash_vectors() {
+    struct Vector { const char *key; uint64_t seed; uint64_t hash; };
+    static const Vector wyhash_vectors[] = {
+        {"", 0, 0x93228a4de0eec5a2ull},
+        {"a", 1, 0xc5bac3db178713c4ull},
+        {"abc", 2, 0xa97f2f7b1d9b3314ull},
+        {"message digest", 3, 0x786d1f1df3801df4ull},
+        {"abcdefghijklmnopqrstuvwxyz", 4, 0xdca5a8138ad37c87ull},
+        {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 5,
+         0xb9e734f117cfaf70ull},
+        {"1234567890123456789012345678901234567890"
+         "1234567890123456789012345678901234567890", 6, 0x6cc5eab49a92d617ull},
+    };
+    struct LengthVector { size_t len; uint64_t seed; uint64_t hash; };
+    static const LengthVector xxh3_vectors[] = {
+        {0, 0, 0x2d06800538d394c2ull},    {3, 1, 0x6b4467b443c76228ull},
+        {8, 2, 0x0ff80b4374e6795aull},    {16, 3, 0x9a99f30f1620c428ull},
+        {40, 4, 0xdd824b880788f46cull},   {128, 5, 0xc3214f2d9f305049ull},
+        {200, 6, 0x8ccc29a73da46a76ull},  {240, 7, 0xbb5292ee87097b62ull},
+        {241, 8, 0x4ecd0cf8a684cb9aull},  {1024, 9, 0x818e29630a2b8c0bull},
+    };
+    bool ok = true;
+    for (const Vector& v : wyhash_vectors) {
+        if (WyHash::hash(v.key, v.seed) != v.hash) {
+            std::cerr << "wyhash differs from its test vector " << v.seed << std::endl;
+            ok = false;
+        }
+    }
+    std::string cycle;
+    for (size_t i = 0; i < 1024; ++i)
+        cycle += static_cast<char>('a' + i % 26);
+    for (const LengthVector& v : xxh3_vectors) {
+        if (Xxh3Hash::hash(std::string_view(cycle).substr(0, v.len), v.seed) != v.hash) {
+            std::cerr << "xxh3 differs from its reference on " << v.len
+                      << " bytes" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+template <typename Hash>
+static void bench_hash_policy(Bench& bench, const std::vector<Email>& emails) {
+    const std::string name = std::string("hash.") + Hash::name;
+    std::mt19937_64 g(1);
+    for (int len : {5, 8, 12, 16, 24, 32, 40, 64, 256}) {
+        const size_t num_keys = 1024;
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < num_keys; ++i) {
+            std::string key;
+            for (int j = 0; j < len; ++j)
+                key += static_cast<char>('a' + g() % 26);
+            keys.push_back(key);
+        }
+        bench.run(name, Params{{"key_len", len}}, num_keys, 0.0, len, [&]() {
+            uint64_t acc = 0;
+            for (const std::string& key : keys)
+                acc += Hash::hash(key, 0);
+            return acc;
+        });
+        std::vector<std::string_view> views(keys.begin(), keys.end());
+        std::vector<uint64_t> out(num_keys);
+        bench.run(name + ".batch", Params{{"key_len", len}}, num_keys, 0.0, len,
+                  [&]() {
+            Hash::hash_batch(views.data(), views.size(), 0, out.data());
+            return out[num_keys - 1];
+        });
+    }
+    // the n-grams of real emails, with their mix of lengths
+    double bytes = total_bytes(emails) / emails.size();
+    for (int ngram : {1, 2, 3}) {
+        bench.run(name + ".ngrams", Params{{"ngram", ngram}}, emails.size(),
+                  1.0, bytes, [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : emails) {
+                EmailIter it(email, ngram);
+                while (it)
+                    acc += Hash::hash(it.next(), 0xa738cc);
+            }
+            return acc;
+        });
+        std::vector<std::string_view> views;
+        std::vector<uint64_t> out;
+        bench.run(name + ".ngrams.batch", Params{{"ngram", ngram}}, emails.size(),
+                  1.0, bytes, [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : emails) {
+                views.clear();
+                EmailIter it(email, ngram);
+                while (it)
+                    views.push_back(it.next());
+                out.resize(views.size());
+                Hash::hash_batch(views.data(), views.size(), 0xa738cc, out.data());
+                acc += out.back();
+            }
+            return acc;
+        });
+    }
+}
+
+static void bench_hash(Bench& bench, const std::vector<Email>& emails) {
+    bench_hash_policy<Murmur3Hash>(bench, emails);
+    bench_hash_policy<Murmur64Hash>(bench, emails);
+    bench_hash_policy<Xxh3Hash>(bench, emails);
+    bench_hash_policy<WyHash>(bench, emails);
+}
+
+static void bench_tokenize(Bench& bench, const std::vector<Email>& emails) {
+    double bytes = total_bytes(emails) / emails.size();
+    bench.run("email_tokenize", Params{}, emails.size(), 1.0, bytes, [&]() {
+        uint64_t acc = 0;
+        for (const Email& email : emails) {
+            Email copy(email.header(), email.body());
+            acc += copy.num_words();
+        }
+        return acc;
+    });
+}
+
+static void bench_ngrams(Bench& bench, const std::vector<Email>& emails) {
+    double bytes = total_bytes(emails) / emails.size();
+    for (int ngram : {1, 2, 3}) {
+        bench.run("email_iter", Params{{"ngram", ngram}}, emails.size(),
+                  1.0, bytes, [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : emails) {
+                EmailIter it(email, ngram);
+                while (it)
+                    acc += it.next().size();
+            }
+            return acc;
+        });
+    }
+}
+
+template <typename Clf>
+static void bench_clf(Bench& bench, const std::string& name, Params params,
+                      Clf& clf, const std::vector<Email>& emails) {
+    params.emplace_back("memory_bytes", clf.memory_bytes());
+    double bytes = total_bytes(emails) / emails.size();
+    bench.run(name + ".update", params, emails.size(), 1.0, bytes, [&]() {
+        for (const Email& email : emails)
+            clf.update(email);
+        return clf.num_examples_processed;
+    });
+    bench.run(name + ".predict", params, emails.size(), 1.0, bytes, [&]() {
+        uint64_t acc = 0;
+        for (const Email& email : emails)
+            acc += clf.classify(clf.predict(email));
+        return acc;
+    });
+}
+
+/** The cursor the classifiers iterate, which hashes in batches. */
+static void bench_ngram_hashes(Bench& bench, const std::vector<Email>& emails) {
+    using Hasher = BaseClf<NaiveBayesFeatureHashing>;
+    double bytes = total_bytes(emails) / emails.size();
+    for (int ngram : {1, 2, 3}) {
+        for (int num_seeds : {1, 3}) {
+            bench.run("email_ngrams.hash",
+                      Params{{"ngram", ngram}, {"num_seeds", num_seeds}},
+                      emails.size(), 1.0, bytes, [&]() {
+                uint64_t acc = 0;
+                for (const Email& email : emails) {
+                    EmailNgrams<Hasher> ngrams(email, ngram);
+                    while (ngrams) {
+                        ngrams.next();
+                        for (int seed = 0; seed < num_seeds; ++seed)
+                            acc += ngrams.hash(seed);
+                    }
+                }
+                return acc;
+            });
+        }
+    }
+}
+
+static void bench_classifiers(Bench& bench, const std::vector<Email>& emails) {
+    for (int ngram : {1, 2, 3}) {
+        for (int log_num_buckets : {10, 14, 18}) {
+            Params p{{"ngram", ngram}, {"log_num_buckets", log_num_buckets}};
+            {
+                NaiveBayesFeatureHashing clf{ngram, log_num_buckets};
+                bench_clf(bench, "naive_bayes_feature_hashing", p, clf, emails);
+            }
+            {
+                PerceptronFeatureHashing clf{ngram, log_num_buckets, 0.001};
+                bench_clf(bench, "perceptron_feature_hashing", p, clf, emails);
+            }
+            for (int num_hashes : {1, 3, 5}) {
+                Params pcm = p;
+                pcm.emplace_back("num_hashes", num_hashes);
+                {
+                    NaiveBayesCountMin clf{ngram, num_hashes, log_num_buckets};
+                    bench_clf(bench, "naive_bayes_count_min", pcm, clf, emails);
+                }
+                {
+                    PerceptronCountMin clf{ngram, num_hashes, log_num_buckets,
+                                           0.001};
+                    bench_clf(bench, "perceptron_count_min", pcm, clf, emails);
+                }
+            }
+        }
+    }
+}
+
+/** Overhead of the top-k tracker (`HeavyHitters`, keyed by the count-min
+ * estimates) on the update path. */
+static void bench_heavy_hitters(Bench& bench, const std::vector<Email>& emails) {
+    for (int ngram : {1, 2}) {
+        for (int capacity : {0, 100, 1000}) {
+            Params p{{"ngram", ngram}, {"log_num_buckets", 14},
+                     {"num_hashes", 3}, {"capacity", capacity}};
+            NaiveBayesCountMin clf{ngram, 3, 14};
+            clf.track_heavy_hitters(capacity);
+            bench_clf(bench, "naive_bayes_count_min_heavy_hitters", p, clf, emails);
+        }
+    }
+}
+
+/** Count-min models with and without an exact table for the hot n-grams. */
+static void bench_hot_table(Bench& bench, const std::vector<Email>& emails) {
+    for (int num_hashes : {3, 5}) {
+        for (int capacity : {0, 1024, 8192}) {
+            Params p{{"ngram", 1}, {"log_num_buckets", 18},
+                     {"num_hashes", num_hashes}, {"capacity", capacity}};
+            {
+                NaiveBayesCountMin clf{1, num_hashes, 18};
+                clf.use_hot_table(capacity);
+                bench_clf(bench, "naive_bayes_count_min_hot_table", p, clf, emails);
+            }
+            {
+                PerceptronCountMin clf{1, num_hashes, 18, 0.001};
+                clf.use_hot_table(capacity);
+                bench_clf(bench, "perceptron_count_min_hot_table", p, clf, emails);
+            }
+        }
+    }
+}
+
+/** Anytime prediction: full sums, bound exits only, and an n-gram budget.
+ * The fraction of n-grams that were scored is reported as a parameter. */
+static void bench_anytime(Bench& bench, const std::vector<Email>& emails) {
+    double bytes = total_bytes(emails) / emails.size();
+    for (long budget : {-1L, 0L, 256L, 64L}) {
+        NaiveBayesCountMin clf{2, 3, 16};
+        for (const Email& email : emails)
+            clf.update(email);
+        if (budget >= 0)
+            clf.use_anytime_predict(budget);
+        early_exit_stats() = EarlyExitStats{};
+        for (const Email& email : emails)
+            clf.predict(email);
+        Params p{{"ngram", 2}, {"log_num_buckets", 16}, {"num_hashes", 3},
+                 {"budget", budget},
+                 {"scored_fraction", early_exit_stats().scored_fraction()}};
+        bench.run("naive_bayes_count_min_anytime.predict", p, emails.size(), 1.0,
+                  bytes, [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : emails)
+                acc += clf.classify(clf.predict(email));
+            return acc;
+        });
+    }
+}
+
+/**
+ * Update throughput of the perceptrons after a few passes over the corpus,
+ * with every update applied, with margin-based skipping of the gradient
+ * steps, and with passive-aggressive steps. Reports the fraction of the
+ * timed updates that was skipped.
+ */
+template <typename Clf>
+static void bench_margin_clf(Bench& bench, const std::string& name, Params params,
+                             Clf& clf, const std::vector<Email>& emails) {
+    for (int epoch = 0; epoch < 5; ++epoch)
+        for (const Email& email : emails)
+            clf.update(email);
+    uint64_t skipped = clf.num_skipped_updates();
+    for (const Email& email : emails)
+        clf.update(email);
+    params.emplace_back("skipped_fraction",
+            double(clf.num_skipped_updates() - skipped) / emails.size());
+    double bytes = total_bytes(emails) / emails.size();
+    bench.run(name + ".update", params, emails.size(), 1.0, bytes, [&]() {
+        for (const Email& email : emails)
+            clf.update(email);
+        return clf.num_examples_processed;
+    });
+}
+
+static void bench_margin_updates(Bench& bench, const std::vector<Email>& emails) {
+    struct Mode { const char *name; double margin, aggressiveness; };
+    for (Mode mode : {Mode{"all", 0.0, 0.0}, Mode{"margin", 0.5, 0.0},
+                      Mode{"passive_aggressive", 1.0, 1.0}}) {
+        Params p{{"ngram", 2}, {"log_num_buckets", 14},
+                 {"margin", mode.margin}, {"aggressiveness", mode.aggressiveness}};
+        std::string suffix = std::string("_") + mode.name;
+        {
+            PerceptronFeatureHashing clf{2, 14, 0.001};
+            if (mode.margin > 0.0)
+                clf.use_margin_updates(mode.margin, mode.aggressiveness);
+            bench_margin_clf(bench, "perceptron_feature_hashing" + suffix, p,
+                             clf, emails);
+        }
+        {
+            p.emplace_back("num_hashes", 3);
+            PerceptronCountMin clf{2, 3, 14, 0.001};
+            if (mode.margin > 0.0)
+                clf.use_margin_updates(mode.margin, mode.aggressiveness);
+            bench_margin_clf(bench, "perceptron_count_min" + suffix, p, clf, emails);
+        }
+    }
+}
+
+/**
+ * FTRL-Proximal on the feature hashing buckets, after a few passes over the
+ * corpus: its update cost, and the
+ * predict cost of the training model and of its sparse export against the
+ * dense perceptron with the same buckets, with the size of each model.
+ */
+static void bench_ftrl(Bench& bench, const std::vector<Email>& emails) {
+    double bytes = total_bytes(emails) / emails.size();
+    for (int log_num_buckets : {14, 20}) {
+        for (double l1 : {0.5, 2.0}) {
+            Params p{{"ngram", 2}, {"log_num_buckets", log_num_buckets},
+                     {"l1", l1}};
+            FtrlFeatureHashing clf{2, log_num_buckets, 0.1, 1.0, l1, 1.0};
+            for (int epoch = 0; epoch < 3; ++epoch)
+                for (const Email& email : emails)
+                    clf.update(email);
+            bench.run("ftrl_feature_hashing.update", p, emails.size(), 1.0, bytes,
+                      [&]() {
+                for (const Email& email : emails)
+                    clf.update(email);
+                return clf.num_examples_processed;
+            });
+            Params pm = p;
+            pm.emplace_back("memory_bytes", clf.memory_bytes());
+            bench.run("ftrl_feature_hashing.predict", pm, emails.size(), 1.0,
+                      bytes, [&]() {
+                uint64_t acc = 0;
+                for (const Email& email : emails)
+                    acc += clf.classify(clf.predict(email));
+                return acc;
+            });
+            SparseModel sparse = clf.export_sparse();
+            Params ps = p;
+            ps.emplace_back("num_entries", sparse.num_entries());
+            ps.emplace_back("memory_bytes", sparse.memory_bytes());
+            bench.run("sparse_model.predict", ps, emails.size(), 1.0, bytes, [&]() {
+                uint64_t acc = 0;
+                for (const Email& email : emails)
+                    acc += sparse.classify(sparse.predict(email));
+                return acc;
+            });
+        }
+    }
+}
+
+/**
+ * Campaign traffic: a stream in which a share of the emails are exact copies
+ * of a few campaign emails, scored by a frozen model with and without a
+ * `PredictionCache` in front of `predict`. Every pass starts with an empty
+ * cache, so only the duplicates within the stream hit.
+ */
+static void bench_prediction_cache(Bench& bench, const std::vector<Email>& emails) {
+    NaiveBayesCountMin clf{2, 3, 16};
+    for (const Email& email : emails)
+        clf.update(email);
+    const size_t num_campaigns = std::max<size_t>(1, emails.size() / 16);
+    for (double dup_fraction : {0.0, 0.5, 0.9}) {
+        std::mt19937_64 g(7);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        std::vector<const Email *> stream;
+        for (size_t i = 0; i < emails.size(); ++i) {
+            stream.push_back(coin(g) < dup_fraction
+                    ? &emails[g() % num_campaigns] : &emails[i]);
+        }
+        double bytes = 0.0;
+        for (const Email *email : stream)
+            bytes += email->body().size();
+        bytes /= stream.size();
+
+        Params p{{"ngram", 2}, {"log_num_buckets", 16}, {"num_hashes", 3},
+                 {"dup_fraction", dup_fraction}};
+        bench.run("naive_bayes_count_min.predict", p, stream.size(), 1.0, bytes,
+                  [&]() {
+            uint64_t acc = 0;
+            for (const Email *email : stream)
+                acc += clf.classify(clf.predict(*email));
+            return acc;
+        });
+        PredictionCache::Stats stats;
+        {
+            PredictionCache cache{4096};
+            for (const Email *email : stream)
+                cache.predict(clf, *email);
+            stats = cache.stats();
+        }
+        p.emplace_back("hit_rate", stats.hit_rate());
+        bench.run("prediction_cache.predict", p, stream.size(), 1.0, bytes, [&]() {
+            PredictionCache cache{4096};
+            uint64_t acc = 0;
+            for (const Email *email : stream)
+                acc += clf.classify(cache.predict(clf, *email));
+            return acc;
+        });
+    }
+}
+
+/** A copy of `email` with about `fraction` of its words replaced. */
+static Email mutate(const Email& email, double fraction, std::mt19937_64& g) {
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::string body;
+    for (size_t i = 0; i < email.num_words(); ++i) {
+        if (i > 0)
+            body += ' ';
+        if (coin(g) < fraction)
+            body += "w" + std::to_string(g() % 100000);
+        else
+            body += email.get_word(i);
+    }
+    return Email(email.header(), body);
+}
+
+/**
+ * Near-duplicate campaign traffic: like `bench_prediction_cache`, but the
+ * copies of the campaign emails have 2% of their words replaced, so that
+ * only a `NearDuplicateIndex` finds them. Reports the share of the stream
+ * served from the index and how often that changed the hard label, and the
+ * cost of a lookup (signature and candidates) in a full index.
+ */
+static void bench_near_duplicate(Bench& bench, const std::vector<Email>& emails) {
+    NaiveBayesCountMin clf{2, 3, 16};
+    for (const Email& email : emails)
+        clf.update(email);
+    const size_t num_campaigns = std::max<size_t>(1, emails.size() / 16);
+    for (double dup_fraction : {0.0, 0.5, 0.9}) {
+        std::mt19937_64 g(7);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        std::vector<Email> stream;
+        for (size_t i = 0; i < emails.size(); ++i) {
+            stream.push_back(coin(g) < dup_fraction
+                    ? mutate(emails[g() % num_campaigns], 0.02, g) : emails[i]);
+        }
+        double bytes = total_bytes(stream) / stream.size();
+
+        Params p{{"ngram", 2}, {"log_num_buckets", 16}, {"num_hashes", 3},
+                 {"dup_fraction", dup_fraction}};
+        bench.run("naive_bayes_count_min.predict", p, stream.size(), 1.0, bytes,
+                  [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : stream)
+                acc += clf.classify(clf.predict(email));
+            return acc;
+        });
+
+        NearDuplicateIndex::Stats stats;
+        size_t label_changes = 0;
+        {
+            NearDuplicateIndex index{4096};
+            for (const Email& email : stream)
+                label_changes += clf.classify(index.predict(clf, email))
+                        != clf.classify(clf.predict(email));
+            stats = index.stats();
+        }
+        p.emplace_back("hit_rate", stats.hit_rate());
+        p.emplace_back("label_changes", double(label_changes) / stream.size());
+        bench.run("near_duplicate.predict", p, stream.size(), 1.0, bytes, [&]() {
+            NearDuplicateIndex index{4096};
+            uint64_t acc = 0;
+            for (const Email& email : stream)
+                acc += clf.classify(index.predict(clf, email));
+            return acc;
+        });
+    }
+
+    NearDuplicateIndex index{4096};
+    MinHashSignature sig;
+    for (const Email& email : emails) {
+        index.signature(email, sig);
+        index.insert(sig, 0, 0.0);
+    }
+    std::mt19937_64 g(11);
+    std::vector<Email> queries;
+    for (const Email& email : emails)
+        queries.push_back(mutate(email, 0.02, g));
+    double bytes = total_bytes(queries) / queries.size();
+    Params p{{"shingle", 2}, {"num_bands", 16}, {"rows_per_band", 4},
+             {"indexed", double(index.size())}};
+    bench.run("near_duplicate.lookup", p, queries.size(), 1.0, bytes, [&]() {
+        uint64_t acc = 0;
+        for (const Email& email : queries) {
+            double score;
+            index.signature(email, sig);
+            acc += index.find(sig, 0, score);
+        }
+        return acc;
+    });
+}
+
+/**
+ * A count-min model trained by one writer while other threads score with its
+ * published copy: the writer's update cost per publish interval, and the
+ * reader's predict cost while a writer keeps training in the background.
+ */
+static void bench_concurrent_model(Bench& bench, const std::vector<Email>& emails) {
+    double bytes = total_bytes(emails) / emails.size();
+    for (int publish_every : {1, 64, 1024}) {
+        for (int num_readers : {0, 2}) {
+            Params p{{"ngram", 1}, {"log_num_buckets", 14}, {"num_hashes", 3},
+                     {"publish_every", publish_every}, {"readers", num_readers}};
+            ConcurrentModel<NaiveBayesCountMin> model{
+                    NaiveBayesCountMin{1, 3, 14}, size_t(publish_every)};
+            std::atomic<bool> stop{false};
+            std::vector<std::thread> readers;
+            for (int r = 0; r < num_readers; ++r) {
+                readers.emplace_back([&, r]() {
+                    for (size_t i = r; !stop.load(std::memory_order_relaxed); ++i)
+                        model.predict(emails[i % emails.size()]);
+                });
+            }
+            bench.run("concurrent_model.update", p, emails.size(), 1.0, bytes, [&]() {
+                for (const Email& email : emails)
+                    model.update(email);
+                return model.num_publishes();
+            });
+            stop = true;
+            for (auto& t : readers)
+                t.join();
+        }
+        Params p{{"ngram", 1}, {"log_num_buckets", 14}, {"num_hashes", 3},
+                 {"publish_every", publish_every}};
+        ConcurrentModel<NaiveBayesCountMin> model{
+                NaiveBayesCountMin{1, 3, 14}, size_t(publish_every)};
+        std::atomic<bool> stop{false};
+        std::thread writer([&]() {
+            for (size_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+                model.update(emails[i % emails.size()]);
+        });
+        bench.run("concurrent_model.predict", p, emails.size(), 1.0, bytes, [&]() {
+            uint64_t acc = 0;
+            for (const Email& email : emails)
+                acc += model.classify(email);
+            return acc;
+        });
+        stop = true;
+        writer.join();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string outfname{argc > 1 ? argv[1] : "-"};
+    std::string filter{argc > 2 ? argv[2] : ""};
+
+    if (!check_hash_vectors())
+        return 5;
+    if (const char *kernel = MurmurHash3_x64_128_batch_check()) {
+        std::cerr << "batched murmur3 (" << kernel << ") differs from the scalar hash"
+                  << std::endl;
+        return 5;
+    }
+
+    Bench bench{0.2, 5, filter};
+    CorpusConfig config;
+    config.seed = 42;
+    std::vector<Email> emails = generate_emails(config, 256);
+
+    bench_hash(bench, emails);
+    bench_tokenize(bench, emails);
+    bench_ngrams(bench, emails);
+    bench_ngram_hashes(bench, emails);
+    bench_classifiers(bench, emails);
+    bench_heavy_hitters(bench, emails);
+    bench_hot_table(bench, emails);
+    bench_anytime(bench, emails);
+    bench_margin_updates(bench, emails);
+    bench_ftrl(bench, emails);
+    bench_prediction_cache(bench, emails);
+    bench_near_duplicate(bench, emails);
+    bench_concurrent_model(bench, emails);
+
+    if (outfname == "-") {
+        bench.write_json(std::cout);
+    } else {
+        std::ofstream outfile{outfname};
+        bench.write_json(outfile);
+        std::cerr << "wrote " << bench.results().size() << " results to "
+                  << outfname << std::endl;
+    }
+    return 0;
+}
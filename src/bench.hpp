@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+
+namespace bdap {
+
+/**
+ * A minimal microbenchmark harness.
+ *
+ * Each benchmark is a callable that performs one batch of work and returns
+ * an integer that depends on that work (which is folded into a sink so that
+ * the compiler cannot optimize the work away). The harness first calibrates
+ * how many batches fit in the minimum measurement time, and then reports the
+ * median of several repetitions.
+ */
+struct BenchResult {
+    std::string name;
+    std::vector<std::pair<std::string, double>> params;
+    uint64_t iterations = 0; // number of ops in one repetition
+    double ns_per_op = 0.0;
+    double emails_per_op = 0.0;
+    double bytes_per_op = 0.0;
+    double allocs_per_op = 0.0; // only with BDAP_TRACK_ALLOCS
+    double alloc_bytes_per_op = 0.0;
+
+    double ops_per_sec() const { return 1e9 / ns_per_op; }
+    double emails_per_sec() const { return emails_per_op * ops_per_sec(); }
+    double bytes_per_sec() const { return bytes_per_op * ops_per_sec(); }
+};
+
+class Bench {
+    double min_time_;
+    int repetitions_;
+    std::string filter_;
+    std::vector<BenchResult> results_;
+    volatile uint64_t sink_ = 0;
+
+    using clock = std::chrono::steady_clock;
+
+public:
+    Bench(double min_time = 0.2, int repetitions = 5, std::string filter = "")
+        : min_time_(min_time), repetitions_(repetitions), filter_(filter) {}
+
+    /**
+     * Run `fn` repeatedly. One call of `fn` counts as `ops_per_call` ops,
+     * and each op processes `emails_per_op` emails and `bytes_per_op` bytes.
+     */
+    template <typename F>
+    void run(const std::string& name,
+             std::vector<std::pair<std::string, double>> params,
+             uint64_t ops_per_call, double emails_per_op, double bytes_per_op,
+             F&& fn)
+    {
+        if (!filter_.empty() && name.find(filter_) == std::string::npos)
+            return;
+
+        // calibrate: grow the number of calls until it takes long enough
+        uint64_t calls = 1;
+        for (;;) {
+            double t = time_calls(fn, calls);
+            if (t >= min_time_ / repetitions_ || calls >= (uint64_t(1) << 40))
+                break;
+            double factor = t > 0.0 ? (min_time_ / repetitions_) / t : 10.0;
+            calls = std::max(calls + 1,
+                    static_cast<uint64_t>(calls * std::min(10.0, factor * 1.2)));
+        }
+
+        AllocStats allocs_begin = thread_alloc_stats();
+        std::vector<double> times;
+        for (int r = 0; r < repetitions_; ++r)
+            times.push_back(time_calls(fn, calls));
+        AllocStats allocs = thread_alloc_stats();
+        allocs -= allocs_begin;
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+
+        BenchResult res;
+        res.name = name;
+        res.params = std::move(params);
+        res.iterations = calls * ops_per_call;
+        res.ns_per_op = median * 1e9 / res.iterations;
+        res.emails_per_op = emails_per_op;
+        res.bytes_per_op = bytes_per_op;
+        res.allocs_per_op = static_cast<double>(allocs.allocs)
+            / (res.iterations * repetitions_);
+        res.alloc_bytes_per_op = static_cast<double>(allocs.bytes)
+            / (res.iterations * repetitions_);
+        results_.push_back(std::move(res));
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+    /** Write all results as a JSON array. */
+    void write_json(std::ostream& os) const {
+        os << "[\n";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const BenchResult& r = results_[i];
+            os << "  {\"name\": \"" << r.name << "\", \"params\": {";
+            for (size_t j = 0; j < r.params.size(); ++j)
+                os << (j ? ", " : "") << '"' << r.params[j].first << "\": "
+                   << r.params[j].second;
+            os << "}, \"iterations\": " << r.iterations
+               << ", \"ns_per_op\": " << r.ns_per_op
+               << ", \"ops_per_sec\": " << r.ops_per_sec();
+            if (r.emails_per_op > 0.0)
+                os << ", \"emails_per_sec\": " << r.emails_per_sec();
+            if (r.bytes_per_op > 0.0)
+                os << ", \"bytes_per_sec\": " << r.bytes_per_sec();
+#if BDAP_TRACK_ALLOCS
+            os << ", \"allocs_per_op\": " << r.allocs_per_op
+               << ", \"alloc_bytes_per_op\": " << r.alloc_bytes_per_op;
+#endif
+            os << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+        }
+        os << "]\n";
+    }
+
+private:
+    template <typename F>
+    double time_calls(F& fn, uint64_t calls) {
+        uint64_t acc = 0;
+        clock::time_point begin = clock::now();
+        for (uint64_t c = 0; c < calls; ++c)
+            acc += static_cast<uint64_t>(fn());
+        clock::time_point end = clock::now();
+        sink_ = sink_ + acc;
+        return std::chrono::duration<double>(end - begin).count();
+    }
+};
+
+} // namespace bdap
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "email.hpp"
+
+namespace bdap {
+
+/**
+ * A classifier that can be trained by one writer thread while any number of
+ * reader threads score with it, in the style of read-copy-update.
+ *
+ * Two copies of the model are kept. Readers only use the published copy;
+ * the writer updates the other one and publishes it every `publish_every`
+ * updates by swapping the roles. Instead of copying the whole model, the
+ * copy that was just retired is brought up to date incrementally: before the
+ * writer updates it again, it replays onto it the emails of the interval it
+ * missed. Both copies thus see the exact same sequence of updates, at the
+ * cost of training every email twice, which is independent of the size of
+ * the model (a full copy of a 2^20 bucket count-min sketch per publish is
+ * not).
+ *
+ * Readers never block and never take a lock: they announce themselves with
+ * an atomic counter on the copy they use, and retry if a publish happened in
+ * between. Only the writer waits, for the readers of a retired copy to
+ * leave, before it touches that copy again.
+ */
+template <typename Clf>
+class ConcurrentModel {
+    struct alignas(64) ReaderCount {
+        std::atomic<size_t> n{0};
+    };
+
+    Clf models_[2];
+    mutable ReaderCount readers_[2]; // readers of each copy
+    std::atomic<int> current_{0}; // the published copy
+    std::atomic<uint64_t> version_{0}; // updates in the published copy
+
+    // writer state
+    uint64_t num_updates_ = 0;
+    size_t publish_every_;
+    size_t since_publish_ = 0;
+    bool standby_ready_ = true; // the standby copy is up to date
+    std::vector<Email> missed_; // the updates since the last publish
+    size_t num_publishes_ = 0;
+
+public:
+    /** Read access to the published copy, for as long as the guard lives. */
+    class Reader {
+        const ConcurrentModel *model_;
+        int index_;
+
+    public:
+        explicit Reader(const ConcurrentModel& model) : model_(&model) {
+            for (;;) {
+                index_ = model.current_.load();
+                model.readers_[index_].n.fetch_add(1);
+                if (model.current_.load() == index_)
+                    break;
+                model.readers_[index_].n.fetch_sub(1); // raced with a publish
+            }
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        ~Reader() { model_->readers_[index_].n.fetch_sub(1); }
+
+        const Clf& operator*() const { return model_->models_[index_]; }
+        const Clf *operator->() const { return &model_->models_[index_]; }
+    };
+
+    ConcurrentModel(const Clf& clf, size_t publish_every)
+        : models_{clf, clf}
+        , publish_every_(publish_every > 0 ? publish_every : 1) {}
+
+    ConcurrentModel(const ConcurrentModel&) = delete;
+    ConcurrentModel& operator=(const ConcurrentModel&) = delete;
+
+    /** Reader side: score with the published copy. */
+    double predict(const Email& email) const {
+        Reader reader(*this);
+        return reader->predict(email);
+    }
+
+    /** Reader side: hard classification with the published copy. */
+    bool classify(const Email& email) const {
+        Reader reader(*this);
+        return reader->classify(reader->predict(email));
+    }
+
+    /** Number of updates included in the published copy. Read before a
+     * `Reader`, it is at most that of the copy the reader gets. */
+    uint64_t version() const { return version_.load(); }
+
+    /** Writer side: learn from `email`; publishes every `publish_every`
+     * updates. Only one thread may call the writer methods. */
+    void update(const Email& email) {
+        Clf& standby = catch_up();
+        standby.update(email);
+        missed_.push_back(email);
+        ++num_updates_;
+        if (++since_publish_ >= publish_every_)
+            publish();
+    }
+
+    /** Writer side: make all updates so far visible to the readers. */
+    void publish() {
+        if (since_publish_ == 0)
+            return;
+        int standby = 1 - current_.load();
+        current_.store(standby);
+        version_.store(num_updates_);
+        since_publish_ = 0;
+        standby_ready_ = false;
+        ++num_publishes_;
+    }
+
+    /** Writer side: the publish interval, in updates. */
+    void set_publish_every(size_t n) { publish_every_ = n > 0 ? n : 1; }
+    size_t publish_every() const { return publish_every_; }
+    size_t num_publishes() const { return num_publishes_; }
+
+private:
+    /** The standby copy, after waiting for the last readers of its previous
+     * interval as the published copy and replaying the updates it missed. */
+    Clf& catch_up() {
+        Clf& standby = models_[1 - current_.load()];
+        if (!standby_ready_) {
+            int index = 1 - current_.load();
+            while (readers_[index].n.load() != 0)
+                std::this_thread::yield();
+            for (const Email& email : missed_)
+                standby.update(email);
+            missed_.clear();
+            standby_ready_ = true;
+        }
+        return standby;
+    }
+};
+
+} // namespace bdap
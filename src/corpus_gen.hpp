@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "email.hpp"
+
+namespace bdap {
+
+/**
+ * Samples ranks in [0, n) with P(rank = r) proportional to 1 / (r+1)^s.
+ *
+ * Uses inversion over a precomputed CDF, so sampling is a binary search and
+ * memory is O(n).
+ */
+class ZipfDistribution {
+    std::vector<double> cdf_;
+
+public:
+    ZipfDistribution(size_t n, double s) : cdf_(n) {
+        if (n == 0)
+            throw std::invalid_argument("empty Zipf distribution");
+        double sum = 0.0;
+        for (size_t r = 0; r < n; ++r) {
+            sum += 1.0 / std::pow(static_cast<double>(r + 1), s);
+            cdf_[r] = sum;
+        }
+        for (double& c : cdf_)
+            c /= sum;
+    }
+
+    template <typename G>
+    size_t operator()(G& g) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(g);
+        auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+        return std::min(static_cast<size_t>(it - cdf_.begin()), cdf_.size() - 1);
+    }
+};
+
+enum class LengthDist { Fixed, Uniform, LogNormal };
+
+/** Parameters of a synthetic corpus. Equal configs give equal corpora (for
+ * a given standard library, which implements the random distributions). */
+struct CorpusConfig {
+    uint64_t seed = 1;
+    size_t vocab_size = 100000;
+    double zipf_s = 1.1;
+    double spam_ratio = 0.5;
+
+    // Probability that a word is drawn from the vocabulary ranking shared by
+    // both classes rather than from the class-specific ranking. The higher,
+    // the harder the classification problem.
+    double overlap = 0.7;
+
+    // Email length in words
+    LengthDist length_dist = LengthDist::LogNormal;
+    double mean_length = 200.0;
+    double length_sigma = 1.0; // of log-length for LogNormal
+    size_t min_length = 1;
+    size_t max_length = 20000;
+};
+
+/**
+ * A seeded generator of spam/ham emails with Zipf-distributed vocabularies.
+ *
+ * Both classes share the same Zipf law over ranks, but map ranks to words
+ * through different permutations of the vocabulary, so that the frequent
+ * spam words differ from the frequent ham words.
+ */
+class SyntheticCorpus {
+    CorpusConfig config_;
+    std::mt19937_64 g_;
+    ZipfDistribution zipf_;
+    std::vector<std::string> vocab_;
+    std::vector<uint32_t> common_rank_;
+    std::vector<uint32_t> spam_rank_;
+    std::vector<uint32_t> ham_rank_;
+    uint64_t num_generated_ = 0;
+
+public:
+    explicit SyntheticCorpus(const CorpusConfig& config)
+        : config_(config)
+        , g_(config.seed)
+        , zipf_(config.vocab_size, config.zipf_s)
+    {
+        vocab_.reserve(config.vocab_size);
+        for (size_t i = 0; i < config.vocab_size; ++i)
+            vocab_.push_back(make_word(i));
+
+        common_rank_.resize(config.vocab_size);
+        std::iota(common_rank_.begin(), common_rank_.end(), 0);
+        spam_rank_ = common_rank_;
+        ham_rank_ = common_rank_;
+        std::shuffle(common_rank_.begin(), common_rank_.end(), g_);
+        std::shuffle(spam_rank_.begin(), spam_rank_.end(), g_);
+        std::shuffle(ham_rank_.begin(), ham_rank_.end(), g_);
+    }
+
+    const CorpusConfig& config() const { return config_; }
+    uint64_t num_generated() const { return num_generated_; }
+
+    /** Generate the label and body of the next email. */
+    bool next_body(std::string& body) {
+        std::uniform_real_distribution<double> unif(0.0, 1.0);
+        bool is_spam = unif(g_) < config_.spam_ratio;
+        const std::vector<uint32_t>& class_rank = is_spam ? spam_rank_ : ham_rank_;
+
+        body.clear();
+        size_t len = next_length();
+        for (size_t i = 0; i < len; ++i) {
+            size_t rank = zipf_(g_);
+            bool common = unif(g_) < config_.overlap;
+            if (i > 0)
+                body += ' ';
+            body += vocab_[(common ? common_rank_ : class_rank)[rank]];
+        }
+        ++num_generated_;
+        return is_spam;
+    }
+
+    Email next() {
+        std::string body;
+        bool is_spam = next_body(body);
+        return Email(header(is_spam), body);
+    }
+
+    static std::string header(bool is_spam)
+    { return is_spam ? "EMAIL> label=1" : "EMAIL> label=0"; }
+
+private:
+    size_t next_length() {
+        double len = config_.mean_length;
+        switch (config_.length_dist) {
+        case LengthDist::Fixed:
+            break;
+        case LengthDist::Uniform:
+            len = std::uniform_real_distribution<double>(
+                    config_.min_length, 2.0 * config_.mean_length
+                    - config_.min_length)(g_);
+            break;
+        case LengthDist::LogNormal: {
+            // choose mu such that the mean of the log-normal is mean_length
+            double sigma = config_.length_sigma;
+            double mu = std::log(config_.mean_length) - 0.5 * sigma * sigma;
+            len = std::lognormal_distribution<double>(mu, sigma)(g_);
+            break;
+        }
+        }
+        size_t n = static_cast<size_t>(std::llround(len));
+        return std::clamp(n, config_.min_length, config_.max_length);
+    }
+
+    /** Word `i` as a lowercase string of at least two letters (bijective
+     * base 26, skipping the single letter words). */
+    static std::string make_word(size_t i) {
+        std::string w;
+        i += 26;
+        do {
+            w += static_cast<char>('a' + i % 26);
+            i = i / 26;
+        } while (i-- > 0);
+        return w;
+    }
+};
+
+/** Generate `n` emails in memory, e.g., to feed `stream_emails` directly. */
+inline std::vector<Email> generate_emails(const CorpusConfig& config, size_t n) {
+    SyntheticCorpus corpus(config);
+    std::vector<Email> emails;
+    emails.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        emails.push_back(corpus.next());
+    return emails;
+}
+
+/**
+ * Write emails in the `EMAIL> label=X` corpus format until at least
+ * `num_bytes` bytes were written. The output is streamed, so the size is not
+ * limited by memory. Returns the number of emails written.
+ */
+inline uint64_t write_corpus(std::ostream& os, const CorpusConfig& config,
+                             uint64_t num_bytes) {
+    SyntheticCorpus corpus(config);
+    std::string body;
+    uint64_t written = 0;
+    while (written < num_bytes) {
+        bool is_spam = corpus.next_body(body);
+        std::string header = SyntheticCorpus::header(is_spam)
+            + " id=" + std::to_string(corpus.num_generated());
+        // `read_emails` joins the lines of a body, so keep it on one line
+        os << header << '\n' << body << "\n\n";
+        written += header.size() + body.size() + 3;
+        if (!os)
+            throw std::runtime_error("failed to write corpus");
+    }
+    return corpus.num_generated();
+}
+
+} // namespace bdap
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * An array of exponentially time-decayed counters, decayed lazily.
+ *
+ * Time is measured in updates (emails) and rounded down to epochs of
+ * `epoch_length` updates. Every counter stores its value as of the epoch in
+ * which it was last written, and that epoch. A read scales the value by the
+ * decay since then; a write first rescales it to the current epoch. Decay
+ * therefore costs O(1) per access and never needs a pass over the array.
+ *
+ * A count loses half of its weight every `half_life` updates (with epoch
+ * granularity).
+ */
+class DecayedCounts {
+    std::vector<float> values_;
+    std::vector<uint32_t> epochs_;
+    std::vector<double> factors_; // decay after `age` epochs, until negligible
+    uint32_t epoch_length_ = 1;
+    uint32_t epoch_ = 0;
+
+public:
+    DecayedCounts() = default;
+
+    DecayedCounts(size_t size, double half_life, uint32_t epoch_length)
+        : values_(size, 0.0f)
+        , epochs_(size, 0)
+    { set_decay(half_life, epoch_length); }
+
+    bool enabled() const { return !values_.empty(); }
+    size_t size() const { return values_.size(); }
+    uint32_t epoch() const { return epoch_; }
+
+    /** Decay after `age` epochs. */
+    double decay(uint32_t age) const
+    { return age < factors_.size() ? factors_[age] : 0.0; }
+
+    /** Move the clock to update `t`, and return the decay since the previous
+     * epoch (1.0 if the epoch did not change), so that the caller can decay
+     * its totals eagerly. */
+    double advance(uint64_t t) {
+        uint32_t epoch = static_cast<uint32_t>(t / epoch_length_);
+        double f = decay(epoch - epoch_);
+        epoch_ = epoch;
+        return f;
+    }
+
+    /**
+     * Change the half-life and epoch length from update `t` on, keeping the
+     * current values: every counter is rescaled to the current epoch once,
+     * and the clock restarts in epochs of the new length.
+     */
+    void retune(double half_life, uint32_t epoch_length, uint64_t t) {
+        for (size_t i = 0; i < values_.size(); ++i)
+            values_[i] = static_cast<float>(get(i));
+        set_decay(half_life, epoch_length);
+        epoch_ = static_cast<uint32_t>(t / epoch_length_);
+        std::fill(epochs_.begin(), epochs_.end(), epoch_);
+    }
+
+    /** The value of counter `i` at the current epoch. */
+    double get(size_t i) const
+    { return values_[i] * decay(epoch_ - epochs_[i]); }
+
+    /** Add `d` to counter `i`, and return its new value. */
+    double add(size_t i, double d = 1.0) {
+        double v = get(i) + d;
+        values_[i] = static_cast<float>(v);
+        epochs_[i] = epoch_;
+        return v;
+    }
+
+    size_t memory_bytes() const {
+        return values_.capacity() * sizeof(float)
+            + epochs_.capacity() * sizeof(uint32_t)
+            + factors_.capacity() * sizeof(double);
+    }
+
+private:
+    void set_decay(double half_life, uint32_t epoch_length) {
+        epoch_length_ = std::max<uint32_t>(1, epoch_length);
+        double per_epoch = std::pow(0.5, epoch_length_ / half_life);
+        factors_.clear();
+        for (double f = 1.0; f > 1e-9; f *= per_epoch)
+            factors_.push_back(f);
+    }
+};
+
+} // namespace bdap
@@ -7,6 +7,7 @@
  * Version: 0.2
  */
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -14,6 +15,8 @@
 #include <string_view>
 #include <vector>
 
+#include "profile.hpp"
+
 namespace bdap {
 
 class Email {
@@ -27,6 +30,8 @@ public:
         , body_(body)
         , words_{}
     {
+        BDAP_PROFILE_SCOPE(Phase::Tokenize, body_.size());
+
         // find start indices of words in body
         size_t prev = 0;
         for (size_t i = 0; i < body_.size(); ++i) {
@@ -74,8 +79,8 @@ class EmailIter {
     int i_;
 
 public:
-  EmailIter(const Email &email, int ngram_)
-      : ngram_(ngram_), email_(email), k_{1}, i_{0}
+  EmailIter(const Email &email, int ngram)
+      : ngram_(ngram), email_(email), k_{1}, i_{0}
   {
       int num_words = static_cast<int>(email.num_words());
       if (num_words < ngram_)
@@ -107,6 +112,7 @@ public:
 };
 
 static void read_emails(std::ifstream& f, std::vector<Email>& emails) {
+    BDAP_PROFILE_SCOPE(Phase::Parse, 0);
     std::stringstream wordsbuf;
     std::string line;
     std::string header;
@@ -137,5 +143,29 @@ static void read_emails(std::ifstream& f, std::vector<Email>& emails) {
     }
 }
 
+/** `read_emails` on a corpus that is already in memory, e.g., a mapped file
+ * or a part of it that starts at an `EMAIL> ` line. */
+inline void parse_emails(std::string_view text, std::vector<Email>& emails) {
+    BDAP_PROFILE_SCOPE(Phase::Parse, text.size());
+    std::string header;
+    std::string body;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = std::min(text.find('\n', pos), text.size());
+        std::string_view line = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (line.empty() && !header.empty()) { // end of an email
+            emails.emplace_back(header, body);
+            header.clear();
+            body.clear();
+        }
+        else if (line.compare(0, 7, "EMAIL> ") == 0)
+            header.assign(line);
+        else
+            body.append(line);
+    }
+}
+
 
 } // namespace bdap
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "email.hpp"
+#include "base_classifier.hpp"
+#include "sparse_model.hpp"
+
+namespace bdap {
+
+/**
+ * Logistic regression on the hashed n-grams of `PerceptronFeatureHashing`
+ * (same seed, same buckets, n-gram counts as feature values), trained with
+ * FTRL-Proximal: per-bucket adaptive learning rates (AdaGrad) and L1 and L2
+ * regularization (McMahan et al., "Ad click prediction: a view from the
+ * trenches", 2013).
+ *
+ * Per bucket the model keeps the sum of the gradients `z` and of the squared
+ * gradients `n`; the weight is derived from them lazily, only for the buckets
+ * of the email at hand:
+ *
+ *     w = 0                                            if |z| <= l1
+ *     w = -(z - sign(z) * l1) / ((beta + sqrt(n)) / alpha + l2)  otherwise
+ *
+ * The L1 term keeps the weights of rare and uninformative n-grams exactly
+ * zero, so that `export_sparse` can drop them: the scoring model is a small
+ * fraction of the training state.
+ *
+ * The soft label is the probability of spam, thresholded at 0.5.
+ */
+class FtrlFeatureHashing : public BaseClf<FtrlFeatureHashing> {
+    int ngram_;
+    int log_num_buckets_;
+    double alpha_;
+    double beta_;
+    double l1_;
+    double l2_;
+    std::vector<double> z_;
+    std::vector<double> n_;
+
+    int seed_;
+
+    std::vector<int> buckets_; // scratch for `update_`, one per n-gram
+
+public:
+    FtrlFeatureHashing(int ngram, int log_num_buckets, double alpha = 0.1,
+                       double beta = 1.0, double l1 = 1.0, double l2 = 1.0)
+        : BaseClf(0.5)
+        , ngram_(ngram)
+        , log_num_buckets_(log_num_buckets)
+        , alpha_(alpha)
+        , beta_(beta)
+        , l1_(l1)
+        , l2_(l2)
+        , seed_(0xa738cc) // that of `PerceptronFeatureHashing`
+    {
+        if (log_num_buckets < 0 || log_num_buckets > 31 || alpha <= 0.0
+                || beta < 0.0 || l1 < 0.0 || l2 < 0.0)
+            throw std::invalid_argument("invalid FTRL parameters");
+        z_.resize(size_t(1) << log_num_buckets_, 0.0);
+        n_.resize(size_t(1) << log_num_buckets_, 0.0);
+    }
+
+    int ngram() const { return ngram_; }
+
+    void require_hashes(HashSpec& spec) const { spec.require_seed(ngram_, seed_); }
+
+    template <typename E> // Email or HashedEmail
+    void update_(const E& email) {
+        auto allngrams = ngrams_of(email, ngram_);
+        buckets_.clear();
+        while (allngrams) {
+            allngrams.next();
+            buckets_.push_back(static_cast<int>(get_bucket(allngrams.hash(seed_))));
+        }
+        // the active buckets with their counts
+        std::sort(buckets_.begin(), buckets_.end());
+        double a = 0.0;
+        for (size_t i = 0; i < buckets_.size();) {
+            size_t j = next_run(i);
+            a += (j - i) * weight(buckets_[i]);
+            i = j;
+        }
+        // gradient of the log loss: (p - y) * count
+        double g_a = sigmoid(a) - (email.is_spam() ? 1.0 : 0.0);
+        for (size_t i = 0; i < buckets_.size();) {
+            size_t j = next_run(i);
+            int b = buckets_[i];
+            double g = g_a * (j - i);
+            double sigma = (std::sqrt(n_[b] + g * g) - std::sqrt(n_[b])) / alpha_;
+            z_[b] += g - sigma * weight(b);
+            n_[b] += g * g;
+            i = j;
+        }
+    }
+
+    template <typename E>
+    double predict_(const E& email) const {
+        auto allngrams = ngrams_of(email, ngram_);
+        double a = 0.0;
+        while (allngrams) {
+            allngrams.next();
+            a += weight(get_bucket(allngrams.hash(seed_)));
+        }
+        return sigmoid(a);
+    }
+
+    /** The current weight of `bucket`. */
+    double weight(size_t bucket) const {
+        double z = z_[bucket];
+        if (std::abs(z) <= l1_)
+            return 0.0;
+        double sign = z < 0.0 ? -1.0 : 1.0;
+        return -(z - sign * l1_) / ((beta_ + std::sqrt(n_[bucket])) / alpha_ + l2_);
+    }
+
+    /** Number of buckets with a non-zero weight. */
+    size_t num_nonzero() const {
+        size_t count = 0;
+        for (double z : z_)
+            count += std::abs(z) > l1_;
+        return count;
+    }
+
+    /** The non-zero weights as a compact model that predicts the same. */
+    SparseModel export_sparse() const {
+        static_assert(SparseModel::hash_kind == hash_kind,
+                      "the sparse model must hash n-grams like the trainer");
+        std::vector<SparseEntry> entries;
+        for (size_t b = 0; b < z_.size(); ++b)
+            if (std::abs(z_[b]) > l1_)
+                entries.push_back({b, weight(b)});
+        return SparseModel(ngram_, log_num_buckets_, seed_, entries);
+    }
+
+    /** Size of the training state in bytes. */
+    size_t memory_bytes() const
+    { return (z_.capacity() + n_.capacity()) * sizeof(double); }
+
+private:
+    size_t get_bucket(size_t hash) const {
+        hash &= (size_t(1) << log_num_buckets_) - 1;
+        return hash;
+    }
+
+    /** The end of the run of equal buckets starting at `i`. */
+    size_t next_run(size_t i) const {
+        size_t j = i + 1;
+        while (j < buckets_.size() && buckets_[j] == buckets_[i])
+            ++j;
+        return j;
+    }
+};
+
+} // namespace bdap
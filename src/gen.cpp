@@ -0,0 +1,108 @@
+/*
+ * Writes a synthetic spam/ham corpus in the `EMAIL> label=X` format.
+ *
+ * Usage: ./bdap_gen <output-file> [key=value ...]
+ *
+ * Keys (defaults in brackets):
+ *   size        approximate output size, with optional K/M/G suffix [100M]
+ *   seed        random seed [1]
+ *   spam_ratio  fraction of spam emails [0.5]
+ *   vocab       vocabulary size [100000]
+ *   zipf        Zipf exponent of the word frequencies [1.1]
+ *   overlap     fraction of words drawn from the shared ranking [0.7]
+ *   length      email length distribution: fixed, uniform or lognormal [lognormal]
+ *   mean_len    mean email length in words [200]
+ *   len_sigma   sigma of the log-length for lognormal [1.0]
+ *   min_len     minimum email length in words [1]
+ *   max_len     maximum email length in words [20000]
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "corpus_gen.hpp"
+
+using namespace bdap;
+
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
+using std::chrono::duration_cast;
+
+static uint64_t parse_size(const std::string& s) {
+    size_t pos = 0;
+    double v = std::stod(s, &pos);
+    std::string suffix = s.substr(pos);
+    if (suffix == "K" || suffix == "k") v *= 1e3;
+    else if (suffix == "M" || suffix == "m") v *= 1e6;
+    else if (suffix == "G" || suffix == "g") v *= 1e9;
+    else if (!suffix.empty())
+        throw std::invalid_argument("invalid size `" + s + "`");
+    return static_cast<uint64_t>(v);
+}
+
+/** Apply `key=value` to the config. Returns false for unknown keys. */
+static bool parse_option(const std::string& key, const std::string& value,
+                         CorpusConfig& config, uint64_t& size) {
+    if (key == "size") size = parse_size(value);
+    else if (key == "seed") config.seed = std::stoull(value);
+    else if (key == "spam_ratio") config.spam_ratio = std::stod(value);
+    else if (key == "vocab") config.vocab_size = std::stoull(value);
+    else if (key == "zipf") config.zipf_s = std::stod(value);
+    else if (key == "overlap") config.overlap = std::stod(value);
+    else if (key == "mean_len") config.mean_length = std::stod(value);
+    else if (key == "len_sigma") config.length_sigma = std::stod(value);
+    else if (key == "min_len") config.min_length = std::stoull(value);
+    else if (key == "max_len") config.max_length = std::stoull(value);
+    else if (key == "length") {
+        if (value == "fixed") config.length_dist = LengthDist::Fixed;
+        else if (value == "uniform") config.length_dist = LengthDist::Uniform;
+        else if (value == "lognormal") config.length_dist = LengthDist::LogNormal;
+        else return false;
+    }
+    else return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: ./bdap_gen <output-file> [key=value ...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string outfname{argv[1]};
+    CorpusConfig config;
+    uint64_t size = 100000000;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg{argv[i]};
+        size_t eq = arg.find('=');
+        bool ok = false;
+        try {
+            ok = eq != std::string::npos
+                && parse_option(arg.substr(0, eq), arg.substr(eq+1), config, size);
+        } catch (const std::exception&) {}
+        if (!ok) {
+            std::cerr << "Invalid option `" << arg << "`" << std::endl;
+            return 2;
+        }
+    }
+
+    std::ofstream outfile{outfname, std::ios::binary};
+    if (!outfile.is_open()) {
+        std::cerr << "Failed to open file `" << outfname << "`" << std::endl;
+        return 3;
+    }
+
+    steady_clock::time_point begin = steady_clock::now();
+    uint64_t num_emails = write_corpus(outfile, config, size);
+    outfile.close();
+    steady_clock::time_point end = steady_clock::now();
+
+    std::cout << "Wrote " << num_emails << " emails to " << outfname << " in "
+        << (duration_cast<milliseconds>(end-begin).count()/1000.0)
+        << "s" << std::endl;
+    return 0;
+}
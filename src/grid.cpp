@@ -0,0 +1,245 @@
+/*
+ * Runs a hyperparameter grid in parallel. Every grid point is trained and
+ * evaluated on its own thread of a work-stealing pool; all runs share one
+ * read-only corpus in memory.
+ *
+ * Usage: ./bdap_grid <window-size> <output-prefix> [key=v1,v2,... ...]
+ *                    [--corpus <file>]... [--synthetic <num-emails>]
+ *
+ * Keys (defaults in brackets):
+ *   type             nbfh, nbcm, pfh and/or pcm [nbfh,nbcm,pfh,pcm]
+ *   ngram            n-gram lengths [1,2]
+ *   num_hashes       count-min rows, count-min models only [3]
+ *   log_num_buckets  log2 of the number of buckets [10,14,18]
+ *   learning_rate    perceptron models only [0.001]
+ *   threads          worker threads, 0 for all cores [0]
+ *
+ * The learning curve of each run is written to `<output-prefix>.<model>.txt`
+ * (see `ClfConfig::name`), and one line per run, with the final scores and
+ * the throughput, to `<output-prefix>.summary.txt`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "any_classifier.hpp"
+#include "email.hpp"
+#include "load_emails.hpp"
+#include "metric.hpp"
+#include "stream.hpp"
+#include "thread_pool.hpp"
+
+using namespace bdap;
+
+using Metric = MultiMetric<ConfusionMatrix, SlidingConfusionMatrix,
+                           FadedConfusionMatrix>;
+
+struct GridResult {
+    ClfConfig config;
+    std::vector<double> scores; // final `Metric::score_names()`
+    size_t num_emails = 0;
+    double seconds = 0.0;
+    size_t memory_bytes = 0;
+};
+
+static std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, ','))
+        parts.push_back(part);
+    return parts;
+}
+
+/** All combinations, skipping the parameters a classifier type does not
+ * have (no duplicate runs). */
+static std::vector<ClfConfig>
+expand_grid(const std::vector<ClfType>& types, const std::vector<int>& ngrams,
+            const std::vector<int>& num_hashes, const std::vector<int>& lnbs,
+            const std::vector<double>& lrs) {
+    std::vector<ClfConfig> grid;
+    for (ClfType type : types) {
+        bool cm = type == ClfType::NaiveBayesCountMin
+            || type == ClfType::PerceptronCountMin;
+        bool perceptron = type == ClfType::PerceptronFeatureHashing
+            || type == ClfType::PerceptronCountMin;
+        for (int ngram : ngrams)
+        for (int k : cm ? num_hashes : std::vector<int>{1})
+        for (int lnb : lnbs)
+        for (double lr : perceptron ? lrs : std::vector<double>{0.0}) {
+            ClfConfig c;
+            c.type = type;
+            c.ngram = ngram;
+            c.num_hashes = k;
+            c.log_num_buckets = lnb;
+            c.learning_rate = lr;
+            grid.push_back(c);
+        }
+    }
+    return grid;
+}
+
+static GridResult run_config(const ClfConfig& config,
+                             const std::vector<Email>& emails, int window,
+                             const std::string& outprefix) {
+    AnyClf clf{config};
+    Metric metric{ConfusionMatrix{}, SlidingConfusionMatrix(window),
+                  FadedConfusionMatrix(window)};
+    std::vector<WindowStats> stats;
+    std::vector<double> metric_values =
+        stream_emails(emails, clf, metric, window, stats);
+
+    std::ofstream outfile{outprefix + "." + config.name() + ".txt"};
+    write_results(outfile, window, config.ngram, emails.size(), metric_values,
+                  stats, Metric::score_names());
+
+    GridResult result;
+    result.config = config;
+    result.scores = metric.get_scores();
+    result.memory_bytes = clf.memory_bytes();
+    for (const WindowStats& ws : stats) {
+        result.num_emails += ws.num_emails;
+        result.seconds += ws.seconds;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./bdap_grid <window-size> <output-prefix>"
+                     " [key=v1,v2,... ...]"
+                     " [--corpus <file>]... [--synthetic <num-emails>]"
+                  << std::endl;
+        return 1;
+    }
+
+    int window = std::atoi(argv[1]);
+    std::string outprefix{argv[2]};
+    std::vector<std::string> corpusfnames;
+    long long num_synthetic = 0;
+
+    std::vector<ClfType> types{ClfType::NaiveBayesFeatureHashing,
+        ClfType::NaiveBayesCountMin, ClfType::PerceptronFeatureHashing,
+        ClfType::PerceptronCountMin};
+    std::vector<int> ngrams{1, 2}, num_hashes{3}, lnbs{10, 14, 18};
+    std::vector<double> lrs{0.001};
+    size_t num_threads = 0;
+
+    try {
+        for (int i = 3; i < argc; ++i) {
+            std::string arg{argv[i]};
+            if (arg == "--corpus" || arg == "--synthetic") {
+                if (i+1 >= argc)
+                    throw std::invalid_argument("missing value for " + arg);
+                if (arg == "--corpus")
+                    corpusfnames.push_back(argv[++i]);
+                else
+                    num_synthetic = std::atoll(argv[++i]);
+                continue;
+            }
+            size_t eq = arg.find('=');
+            if (eq == std::string::npos)
+                throw std::invalid_argument("expected key=value, got " + arg);
+            std::string key = arg.substr(0, eq);
+            std::vector<std::string> values = split(arg.substr(eq + 1));
+            if (key == "type") {
+                types.clear();
+                for (const std::string& v : values)
+                    types.push_back(ClfConfig::parse_type(v));
+            } else if (key == "ngram") {
+                ngrams.clear();
+                for (const std::string& v : values) ngrams.push_back(std::stoi(v));
+            } else if (key == "num_hashes") {
+                num_hashes.clear();
+                for (const std::string& v : values) num_hashes.push_back(std::stoi(v));
+            } else if (key == "log_num_buckets") {
+                lnbs.clear();
+                for (const std::string& v : values) lnbs.push_back(std::stoi(v));
+            } else if (key == "learning_rate") {
+                lrs.clear();
+                for (const std::string& v : values) lrs.push_back(std::stod(v));
+            } else if (key == "threads") {
+                num_threads = std::stoul(values.at(0));
+            } else {
+                throw std::invalid_argument("unknown key " + key);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid arguments: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (window <= 0) {
+        std::cerr << "Invalid window size " << window << std::endl;
+        return 2;
+    }
+
+    std::vector<ClfConfig> grid = expand_grid(types, ngrams, num_hashes, lnbs, lrs);
+    // Longest runs first, so that the short ones fill up the gaps at the end.
+    std::stable_sort(grid.begin(), grid.end(),
+            [](const ClfConfig& a, const ClfConfig& b) {
+                return a.ngram * a.num_hashes > b.ngram * b.num_hashes; });
+
+    int seed = 12;
+    const std::vector<Email> emails = load_corpus(seed, corpusfnames, num_synthetic);
+    std::cout << "#emails: " << emails.size() << std::endl;
+
+    using clock = std::chrono::steady_clock;
+    clock::time_point begin = clock::now();
+
+    std::vector<GridResult> results(grid.size());
+    std::mutex cout_mutex;
+    ThreadPool pool{num_threads};
+    std::cout << "#runs: " << grid.size() << " on " << pool.num_threads()
+              << " threads" << std::endl;
+    for (size_t r = 0; r < grid.size(); ++r) {
+        pool.submit([&, r]() {
+            results[r] = run_config(grid[r], emails, window, outprefix);
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cout << grid[r].name() << ": " << results[r].scores.at(0)
+                      << " in " << results[r].seconds << "s" << std::endl;
+        });
+    }
+    try {
+        pool.wait();
+    } catch (const std::exception& e) {
+        std::cerr << "Run failed: " << e.what() << std::endl;
+        return 4;
+    }
+
+    double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    double run_seconds = 0.0;
+    for (const GridResult& r : results)
+        run_seconds += r.seconds;
+    std::cout << "total: " << seconds << "s wall, " << run_seconds
+              << "s summed over runs, " << pool.num_steals() << " steals"
+              << std::endl;
+
+    std::ofstream summary{outprefix + ".summary.txt"};
+    summary << "window=" << window << std::endl;
+    summary << "#emails=" << emails.size() << std::endl;
+    summary << "#runs=" << results.size() << std::endl;
+    summary << "columns=model emails_per_sec seconds memory_bytes";
+    for (const std::string& name : Metric::score_names())
+        summary << ' ' << name;
+    summary << std::endl;
+    for (const GridResult& r : results) {
+        summary << r.config.name()
+                << ' ' << (r.num_emails / r.seconds)
+                << ' ' << r.seconds
+                << ' ' << r.memory_bytes;
+        for (double s : r.scores)
+            summary << ' ' << s;
+        summary << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "murmurhash.hpp"
+#include "murmurhash_batch.hpp"
+#include "murmurhash64.hpp"
+#include "wyhash.hpp"
+#include "xxh3.hpp"
+
+/**
+ * Hash functions for the n-grams, as policies of `BaseClf`.
+ *
+ * N-grams are short keys (typically 5 to 40 bytes), for which the setup and
+ * finalization of MurmurHash3_x64_128 dominate: it computes 128 bits of which
+ * we fold away half. The other policies produce 64 bits directly.
+ *
+ *  - BDAP_HASH=0 (default): MurmurHash3_x64_128, folded to 64 bits.
+ *  - BDAP_HASH=1: MurmurHash64A.
+ *  - BDAP_HASH=2: XXH3 (64 bits).
+ *  - BDAP_HASH=3: wyhash.
+ *
+ * Each policy also hashes a batch of keys with one seed at once, which
+ * `Murmur3Hash` does in SIMD lanes (see `murmurhash_batch.hpp`); the others
+ * loop.
+ *
+ * BDAP_HASH selects `DefaultHash`, which all classifiers use unless they pass
+ * another policy to `BaseClf`. Different hash functions put the n-grams in
+ * different buckets, so a model must be scored with the hash it was trained
+ * with; snapshots record it (see `SnapshotHeader::hash_function`).
+ */
+#ifndef BDAP_HASH
+#define BDAP_HASH 0
+#endif
+
+namespace bdap {
+
+/** Identifies a hash policy in model snapshots. */
+enum class HashKind : uint32_t {
+    Murmur3 = 0,
+    Murmur64 = 1,
+    Xxh3 = 2,
+    WyHash = 3,
+};
+
+struct Murmur3Hash {
+    static constexpr HashKind kind = HashKind::Murmur3;
+    static constexpr const char *name = "murmur3";
+
+    static uint64_t hash(std::string_view key, uint64_t seed) {
+        uint64_t out[2] = {0};
+        MurmurHash3_x64_128(key.data(), key.size(), static_cast<uint32_t>(seed), &out);
+        return out[0] ^ out[1];
+    }
+
+    static void hash_batch(const std::string_view *keys, size_t n, uint64_t seed,
+                           uint64_t *out)
+    { MurmurHash3_x64_128_batch(keys, n, static_cast<uint32_t>(seed), out); }
+};
+
+struct Murmur64Hash {
+    static constexpr HashKind kind = HashKind::Murmur64;
+    static constexpr const char *name = "murmur64";
+
+    static uint64_t hash(std::string_view key, uint64_t seed)
+    { return MurmurHash64A(key.data(), static_cast<int>(key.size()), seed); }
+
+    static void hash_batch(const std::string_view *keys, size_t n, uint64_t seed,
+                           uint64_t *out)
+    { for (size_t i = 0; i < n; ++i) out[i] = hash(keys[i], seed); }
+};
+
+struct Xxh3Hash {
+    static constexpr HashKind kind = HashKind::Xxh3;
+    static constexpr const char *name = "xxh3";
+
+    static uint64_t hash(std::string_view key, uint64_t seed)
+    { return XXH3_64bits_withSeed(key.data(), key.size(), seed); }
+
+    static void hash_batch(const std::string_view *keys, size_t n, uint64_t seed,
+                           uint64_t *out)
+    { for (size_t i = 0; i < n; ++i) out[i] = hash(keys[i], seed); }
+};
+
+struct WyHash {
+    static constexpr HashKind kind = HashKind::WyHash;
+    static constexpr const char *name = "wyhash";
+
+    static uint64_t hash(std::string_view key, uint64_t seed)
+    { return wyhash(key.data(), key.size(), seed); }
+
+    static void hash_batch(const std::string_view *keys, size_t n, uint64_t seed,
+                           uint64_t *out)
+    { for (size_t i = 0; i < n; ++i) out[i] = hash(keys[i], seed); }
+};
+
+#if BDAP_HASH == 0
+using DefaultHash = Murmur3Hash;
+#elif BDAP_HASH == 1
+using DefaultHash = Murmur64Hash;
+#elif BDAP_HASH == 2
+using DefaultHash = Xxh3Hash;
+#elif BDAP_HASH == 3
+using DefaultHash = WyHash;
+#else
+#error "BDAP_HASH must be 0 (murmur3), 1 (murmur64), 2 (xxh3) or 3 (wyhash)"
+#endif
+
+} // namespace bdap
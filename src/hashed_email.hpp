@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "email.hpp"
+#include "hash_policy.hpp"
+
+namespace bdap {
+
+/**
+ * Iterates the n-grams of an email (in `EmailIter` order) and hashes the
+ * current n-gram on demand with `Hasher::hash`.
+ *
+ * The classifiers are written against this cursor interface
+ *
+ * ```
+ *     while (ngrams) {
+ *         ngrams.next();
+ *         ... ngrams.hash(seed) ...
+ *     }
+ * ```
+ *
+ * so that the same code can also run on precomputed hashes (`HashedNgrams`).
+ *
+ * The n-grams are taken from the email `BATCH` at a time, and the first time
+ * a seed is asked for in a batch, the whole batch is hashed with that seed
+ * with `Hasher::hash_batch` (several keys per SIMD instruction). Up to
+ * `MAX_SEEDS` seeds are kept per batch; more are hashed one by one.
+ */
+template <typename Hasher>
+class EmailNgrams {
+public:
+    static constexpr size_t BATCH = 16;
+    static constexpr size_t MAX_SEEDS = 8;
+
+private:
+    EmailIter iter_;
+    size_t remaining_;
+    size_t pos_ = 0; // of the current n-gram in the batch
+    size_t batch_size_ = 0;
+    std::string_view batch_[BATCH];
+
+    mutable size_t num_seeds_ = 0; // hashed so far in this batch
+    mutable size_t seeds_[MAX_SEEDS];
+    mutable uint64_t hashes_[MAX_SEEDS][BATCH];
+
+public:
+    EmailNgrams(const Email& email, int ngram)
+        : iter_(email, ngram), remaining_(iter_.size()) {}
+
+    operator bool() const { return remaining_ > 0; }
+
+    void next() {
+        if (++pos_ >= batch_size_) {
+            batch_size_ = 0;
+            while (batch_size_ < BATCH && iter_)
+                batch_[batch_size_++] = iter_.next();
+            pos_ = 0;
+            num_seeds_ = 0;
+        }
+        --remaining_;
+    }
+
+    size_t remaining() const { return remaining_; } // n-grams after this one
+    std::string_view ngram() const { return batch_[pos_]; }
+
+    size_t hash(size_t seed) const {
+        for (size_t s = 0; s < num_seeds_; ++s)
+            if (seeds_[s] == seed)
+                return hashes_[s][pos_];
+        if (num_seeds_ == MAX_SEEDS)
+            return Hasher::hash(batch_[pos_], seed);
+        size_t s = num_seeds_++;
+        seeds_[s] = seed;
+        Hasher::hash_batch(batch_, batch_size_, seed, hashes_[s]);
+        return hashes_[s][pos_];
+    }
+};
+
+/** Cursors that know the text of the current n-gram (`EmailNgrams`, not
+ * `HashedNgrams`). */
+template <typename Ngrams, typename = void>
+struct has_ngram_text : std::false_type {};
+
+template <typename Ngrams>
+struct has_ngram_text<Ngrams, std::void_t<
+    decltype(std::declval<const Ngrams&>().ngram())>> : std::true_type {};
+
+/** The text of the current n-gram, or an empty view if it is unknown. */
+template <typename Ngrams>
+std::string_view ngram_text(const Ngrams& ngrams) {
+    if constexpr (has_ngram_text<Ngrams>::value)
+        return ngrams.ngram();
+    else
+        return std::string_view();
+}
+
+/**
+ * The set of hashes that a group of classifiers needs per n-gram: the
+ * sequential seeds 0, 1, ..., num_seq_seeds-1 (used by the count-min models)
+ * and a few other seeds (used by the feature hashing models), for n-grams up
+ * to `max_ngram`.
+ */
+struct HashSpec {
+    int max_ngram = 0;
+    int num_seq_seeds = 0;
+    std::vector<size_t> extra_seeds;
+
+    void require_seq(int ngram, int num_seeds) {
+        max_ngram = std::max(max_ngram, ngram);
+        num_seq_seeds = std::max(num_seq_seeds, num_seeds);
+    }
+
+    void require_seed(int ngram, size_t seed) {
+        max_ngram = std::max(max_ngram, ngram);
+        if (std::find(extra_seeds.begin(), extra_seeds.end(), seed)
+                == extra_seeds.end())
+            extra_seeds.push_back(seed);
+    }
+
+    size_t num_seeds() const { return num_seq_seeds + extra_seeds.size(); }
+};
+
+/**
+ * Cursor over the precomputed hashes of a `HashedEmail`, with the same
+ * interface as `EmailNgrams` (except that the n-gram strings are gone).
+ */
+class HashedNgrams {
+    const uint64_t *next_;
+    const uint64_t *end_;
+    const uint64_t *cur_ = nullptr;
+    const HashSpec *spec_;
+
+public:
+    HashedNgrams(const uint64_t *begin, const uint64_t *end, const HashSpec& spec)
+        : next_(begin), end_(end), spec_(&spec) {}
+
+    operator bool() const { return next_ != end_; }
+
+    void next() {
+        cur_ = next_;
+        next_ += spec_->num_seeds();
+    }
+
+    size_t remaining() const
+    { return static_cast<size_t>(end_ - next_) / spec_->num_seeds(); }
+
+    size_t hash(size_t seed) const {
+        if (seed < static_cast<size_t>(spec_->num_seq_seeds))
+            return cur_[seed];
+        const std::vector<size_t>& extra = spec_->extra_seeds;
+        for (size_t s = 0; s < extra.size(); ++s)
+            if (extra[s] == seed)
+                return cur_[spec_->num_seq_seeds + s];
+        throw std::logic_error("seed not in HashSpec");
+    }
+};
+
+/**
+ * An email whose n-grams were hashed once, for all seeds of a `HashSpec`, so
+ * that several classifiers can share the tokenization and hashing. Each model
+ * masks the shared 64-bit hashes to its own number of buckets.
+ *
+ * The n-grams up to `n` are a prefix of the n-grams up to `max_ngram` in
+ * `EmailIter` order, so a model with a smaller `ngram` uses the first rows.
+ */
+class HashedEmail {
+    const HashSpec *spec_ = nullptr;
+    HashKind hash_kind_ = DefaultHash::kind; // of `Hasher` in `assign`
+    bool is_spam_ = false;
+    size_t num_words_ = 0;
+    std::vector<uint64_t> hashes_; // [ngram][seed]
+
+    // scratch for `assign`
+    std::vector<std::string_view> keys_;
+    std::vector<uint64_t> column_;
+
+public:
+    HashedEmail() = default;
+
+    /** Hash the n-grams of `email` with `Hasher::hash_batch`; only
+     * classifiers with the same `hash_kind` as `Hasher` can use them. */
+    template <typename Hasher>
+    void assign(const Email& email, const HashSpec& spec) {
+        spec_ = &spec;
+        hash_kind_ = Hasher::hash_kind;
+        is_spam_ = email.is_spam();
+        num_words_ = email.num_words();
+
+        keys_.clear();
+        EmailIter iter(email, spec.max_ngram);
+        while (iter)
+            keys_.push_back(iter.next());
+
+        // hash all n-grams with one seed at a time, into column `s`
+        size_t num_seeds = spec.num_seeds();
+        hashes_.resize(keys_.size() * num_seeds);
+        column_.resize(keys_.size());
+        size_t s = 0;
+        auto hash_column = [&](size_t seed) {
+            Hasher::hash_batch(keys_.data(), keys_.size(), seed, column_.data());
+            for (size_t i = 0; i < keys_.size(); ++i)
+                hashes_[i * num_seeds + s] = column_[i];
+            ++s;
+        };
+        for (int seed = 0; seed < spec.num_seq_seeds; ++seed)
+            hash_column(seed);
+        for (size_t seed : spec.extra_seeds)
+            hash_column(seed);
+    }
+
+    bool is_spam() const { return is_spam_; }
+    size_t num_words() const { return num_words_; }
+    HashKind hash_kind() const { return hash_kind_; }
+
+    /** Number of n-grams of length 1 up to `ngram` (as `EmailIter::size`). */
+    size_t num_ngrams(int ngram) const {
+        size_t n = std::min(static_cast<size_t>(ngram), num_words_);
+        return n * num_words_ - n * (n - 1) / 2;
+    }
+
+    HashedNgrams ngrams(int ngram) const {
+        if (ngram > spec_->max_ngram)
+            throw std::logic_error("ngram not in HashSpec");
+        const uint64_t *begin = hashes_.data();
+        return HashedNgrams(begin, begin + num_ngrams(ngram) * spec_->num_seeds(),
+                            *spec_);
+    }
+};
+
+} // namespace bdap
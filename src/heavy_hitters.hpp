@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * Bounded-memory top-k of the keys of a stream, ranked by an external
+ * frequency estimate (a count-min sketch, Cormode and Muthukrishnan).
+ *
+ * Each occurrence of a key is offered together with its current estimate.
+ * A key enters the top-k when its estimate exceeds the smallest tracked
+ * estimate, evicting that key. Count-min estimates only grow, so a key whose
+ * estimate is at most the smallest tracked one cannot be tracked: this check
+ * is all that happens for the long tail of rare n-grams.
+ *
+ * To keep the frequent keys cheap as well, a key is only looked up when its
+ * estimate is a multiple of a power of two: 16, or about 1/16th of the
+ * smallest tracked estimate once that is larger. The tracked estimates lag
+ * behind by less than that, which does not matter for ranking heavy hitters
+ * (but keys seen fewer than 16 times are only tracked until the top-k fills).
+ *
+ * Keys are 64-bit fingerprints (n-gram hashes). The tracked keys live in a
+ * compact min-heap of (estimate, id) pairs, indexed by an open-addressed
+ * table with linear probing; the n-gram texts are only touched on insertion.
+ */
+class HeavyHitters {
+public:
+    struct Item {
+        uint64_t key = 0;
+        std::string ngram; // empty if the n-gram text was not available
+        int count = 0;     // estimate at the last lookup
+    };
+
+private:
+    static constexpr uint32_t EMPTY = ~uint32_t(0);
+
+    struct Entry {
+        int count;
+        uint32_t id;
+    };
+
+    size_t capacity_ = 0;
+    std::vector<Entry> heap_;          // min-heap on count
+    std::vector<uint64_t> keys_;       // by id
+    std::vector<uint32_t> pos_;        // heap position, by id
+    std::vector<uint32_t> slots_;      // table slot, by id
+    std::vector<std::string> ngrams_;  // by id
+    std::vector<uint32_t> table_;      // id or EMPTY
+    size_t mask_ = 0;
+    int min_count_ = 0;                // heap_[0].count
+    int refresh_mask_ = 15;            // power of two minus one
+
+public:
+    HeavyHitters() = default;
+
+    explicit HeavyHitters(size_t capacity) : capacity_(capacity) {
+        size_t size = 1;
+        while (size < 2 * capacity)
+            size *= 2;
+        table_.assign(capacity > 0 ? size : 0, EMPTY);
+        mask_ = table_.empty() ? 0 : table_.size() - 1;
+        heap_.reserve(capacity);
+        keys_.reserve(capacity);
+        pos_.reserve(capacity);
+        slots_.reserve(capacity);
+        ngrams_.reserve(capacity);
+    }
+
+    bool enabled() const { return capacity_ > 0; }
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return heap_.size(); }
+
+    /** One occurrence of `key`, whose frequency is now `estimate`. */
+    void offer(uint64_t key, std::string_view ngram, int estimate) {
+        // The common case, without short-circuit branches: the outcome of
+        // each comparison is hard to predict, their conjunction is not.
+        bool full = heap_.size() == capacity_;
+        if (full & ((estimate <= min_count_) | ((estimate & refresh_mask_) != 0)))
+            return;
+        offer_slow(key, ngram, estimate);
+    }
+
+    /** The `n` items with the highest estimates, highest first. */
+    std::vector<Item> top(size_t n) const {
+        std::vector<Entry> entries = heap_;
+        n = std::min(n, entries.size());
+        std::partial_sort(entries.begin(), entries.begin() + n, entries.end(),
+                [](const Entry& a, const Entry& b) { return a.count > b.count; });
+        std::vector<Item> items(n);
+        for (size_t i = 0; i < n; ++i) {
+            items[i].key = keys_[entries[i].id];
+            items[i].ngram = ngrams_[entries[i].id];
+            items[i].count = entries[i].count;
+        }
+        return items;
+    }
+
+    size_t memory_bytes() const {
+        size_t bytes = heap_.capacity() * sizeof(Entry)
+            + keys_.capacity() * sizeof(uint64_t)
+            + (pos_.capacity() + slots_.capacity() + table_.capacity())
+                * sizeof(uint32_t)
+            + ngrams_.capacity() * sizeof(std::string);
+        for (const std::string& ngram : ngrams_)
+            bytes += ngram.capacity();
+        return bytes;
+    }
+
+private:
+    void offer_slow(uint64_t key, std::string_view ngram, int estimate) {
+        size_t slot = find(key);
+        uint32_t id = table_[slot];
+        if (id != EMPTY) {
+            heap_[pos_[id]].count = estimate;
+            sift_down(pos_[id]);
+        } else if (heap_.size() < capacity_) {
+            id = static_cast<uint32_t>(keys_.size());
+            keys_.push_back(key);
+            ngrams_.emplace_back(ngram);
+            slots_.push_back(static_cast<uint32_t>(slot));
+            pos_.push_back(static_cast<uint32_t>(heap_.size()));
+            heap_.push_back(Entry{estimate, id});
+            table_[slot] = id;
+            sift_up(heap_.size() - 1);
+        } else {
+            id = heap_[0].id; // evict the smallest, reuse its id
+            erase(slots_[id]);
+            slot = find(key); // the erase may have moved entries
+            keys_[id] = key;
+            ngrams_[id].assign(ngram.data(), ngram.size());
+            slots_[id] = static_cast<uint32_t>(slot);
+            table_[slot] = id;
+            heap_[0].count = estimate;
+            sift_down(0);
+        }
+        if (min_count_ != heap_[0].count) {
+            min_count_ = heap_[0].count;
+            refresh_mask_ = 15;
+            while (refresh_mask_ * 32 + 31 < min_count_)
+                refresh_mask_ = refresh_mask_ * 2 + 1;
+        }
+    }
+
+    size_t find(uint64_t key) const {
+        size_t slot = key & mask_;
+        while (table_[slot] != EMPTY && keys_[table_[slot]] != key)
+            slot = (slot + 1) & mask_;
+        return slot;
+    }
+
+    /** Backward shift deletion, keeps probe sequences intact. */
+    void erase(size_t slot) {
+        size_t hole = slot;
+        for (size_t j = (slot + 1) & mask_; table_[j] != EMPTY; j = (j + 1) & mask_) {
+            size_t home = keys_[table_[j]] & mask_;
+            // move j into the hole if its home is not in (hole, j]
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                table_[hole] = table_[j];
+                slots_[table_[hole]] = static_cast<uint32_t>(hole);
+                hole = j;
+            }
+        }
+        table_[hole] = EMPTY;
+    }
+
+    void swap_entries(size_t i, size_t j) {
+        std::swap(heap_[i], heap_[j]);
+        pos_[heap_[i].id] = static_cast<uint32_t>(i);
+        pos_[heap_[j].id] = static_cast<uint32_t>(j);
+    }
+
+    void sift_up(size_t i) {
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (heap_[parent].count <= heap_[i].count)
+                break;
+            swap_entries(i, parent);
+            i = parent;
+        }
+    }
+
+    void sift_down(size_t i) {
+        for (;;) {
+            size_t l = 2 * i + 1, r = l + 1, min = i;
+            if (l < heap_.size() && heap_[l].count < heap_[min].count) min = l;
+            if (r < heap_.size() && heap_[r].count < heap_[min].count) min = r;
+            if (min == i)
+                break;
+            swap_entries(i, min);
+            i = min;
+        }
+    }
+};
+
+} // namespace bdap
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * A small, open-addressed (linear probing) table of exact per-key values for
+ * the n-grams that are currently hot, in front of a count-min sketch.
+ *
+ * Keys are 64-bit n-gram fingerprints (the first hash of the n-gram). The
+ * table is at most half full, so a lookup is usually a single probe into a
+ * cache-resident array. When the table is full, a new key replaces a key
+ * that was not used since the clock hand last passed it (CLOCK, second
+ * chance).
+ *
+ * The classifiers keep updating their sketches for hot keys as well, so a key
+ * can be evicted by just dropping it.
+ */
+template <typename V>
+class HotTable {
+    struct Slot {
+        uint64_t key = 0;
+        V value{};
+        uint8_t used = 0;
+        uint8_t referenced = 0;
+    };
+
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t mask_ = 0;
+    size_t hand_ = 0;
+    std::vector<Slot> slots_;
+
+public:
+    HotTable() = default;
+
+    explicit HotTable(size_t capacity) : capacity_(capacity) {
+        size_t size = 1;
+        while (size < 2 * capacity)
+            size *= 2;
+        if (capacity > 0)
+            slots_.resize(size);
+        mask_ = slots_.empty() ? 0 : slots_.size() - 1;
+    }
+
+    bool enabled() const { return capacity_ > 0; }
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+
+    const V *find(uint64_t key) const {
+        for (size_t i = key & mask_; slots_[i].used; i = (i + 1) & mask_)
+            if (slots_[i].key == key)
+                return &slots_[i].value;
+        return nullptr;
+    }
+
+    /** Like `find`, but also marks the key as recently used. */
+    V *touch(uint64_t key) {
+        for (size_t i = key & mask_; slots_[i].used; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) {
+                slots_[i].referenced = 1;
+                return &slots_[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Add a key that is not in the table, evicting another if full. The
+     * returned pointer is valid until the next `insert`. */
+    V *insert(uint64_t key, const V& value) {
+        if (size_ == capacity_)
+            evict();
+        size_t i = key & mask_;
+        while (slots_[i].used)
+            i = (i + 1) & mask_;
+        slots_[i].key = key;
+        slots_[i].value = value;
+        slots_[i].used = 1;
+        slots_[i].referenced = 1;
+        ++size_;
+        return &slots_[i].value;
+    }
+
+    /** Call `f(key, value)` for every key in the table. */
+    template <typename F>
+    void for_each(F&& f) const {
+        for (const Slot& s : slots_)
+            if (s.used)
+                f(s.key, s.value);
+    }
+
+    size_t memory_bytes() const { return slots_.capacity() * sizeof(Slot); }
+
+private:
+    void evict() {
+        for (;;) {
+            Slot& s = slots_[hand_];
+            if (s.used && !s.referenced) {
+                erase(hand_);
+                return;
+            }
+            s.referenced = 0;
+            hand_ = (hand_ + 1) & mask_;
+        }
+    }
+
+    /** Backward shift deletion, keeps probe sequences intact. */
+    void erase(size_t slot) {
+        size_t hole = slot;
+        for (size_t j = (slot + 1) & mask_; slots_[j].used; j = (j + 1) & mask_) {
+            size_t home = slots_[j].key & mask_;
+            // move j into the hole if its home is not in (hole, j]
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole] = Slot{};
+        --size_;
+    }
+};
+
+} // namespace bdap
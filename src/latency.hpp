@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "profile.hpp" // BDAP_CONCAT
+
+/**
+ * Per-call latency histograms of `predict` and `update`.
+ *
+ * Enable with BDAP_LATENCY=1 (CMake option). Every call of `BaseClf::predict`
+ * and `BaseClf::update` is then timed and recorded in a histogram of the
+ * calling thread, by operation and by the length of the email in words
+ * (buckets of factor 4: <64, <256, <1024, <4096 and longer), so that the
+ * tail of long emails does not drown in the short ones. Histograms are
+ * thread local; merge them with `+=`.
+ */
+#ifndef BDAP_LATENCY
+#define BDAP_LATENCY 0
+#endif
+
+namespace bdap {
+
+/**
+ * A log-linear (HDR style) histogram of nanosecond latencies.
+ *
+ * Values below 2^(SUB_BITS+1) have a bucket each; above, every power of two
+ * is split into 2^SUB_BITS equal buckets, so any value is known to within
+ * 1/2^SUB_BITS (3%) of its magnitude. Recording is a count-leading-zeros,
+ * a shift and an increment. Values from 2^MAX_BITS ns (18 minutes) up share
+ * the last bucket.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int MAX_BITS = 40;
+    static constexpr size_t NUM_BUCKETS =
+        size_t(MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+    double sum_ = 0.0;
+
+public:
+    LatencyHistogram() : counts_(NUM_BUCKETS, 0) {}
+
+    static int highest_bit(uint64_t x) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(x);
+#else
+        int b = 0;
+        while (x >>= 1)
+            ++b;
+        return b;
+#endif
+    }
+
+    static size_t bucket(uint64_t ns) {
+        if (ns < (uint64_t(2) << SUB_BITS))
+            return static_cast<size_t>(ns);
+        int msb = highest_bit(ns);
+        if (msb >= MAX_BITS)
+            return NUM_BUCKETS - 1;
+        int shift = msb - SUB_BITS;
+        return (size_t(shift) << SUB_BITS) + static_cast<size_t>(ns >> shift);
+    }
+
+    /** The smallest value of bucket `b`, and the first of the next one. */
+    static uint64_t bucket_begin(size_t b) {
+        if (b < (size_t(2) << SUB_BITS))
+            return b;
+        size_t shift = (b >> SUB_BITS) - 1;
+        return uint64_t((b & ((size_t(1) << SUB_BITS) - 1)) | (size_t(1) << SUB_BITS))
+            << shift;
+    }
+    static uint64_t bucket_end(size_t b) { return bucket_begin(b + 1); }
+
+    void record(uint64_t ns) {
+        ++counts_[bucket(ns)];
+        ++total_;
+        max_ = std::max(max_, ns);
+        sum_ += static_cast<double>(ns);
+    }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& o) {
+        for (size_t b = 0; b < NUM_BUCKETS; ++b)
+            counts_[b] += o.counts_[b];
+        total_ += o.total_;
+        max_ = std::max(max_, o.max_);
+        sum_ += o.sum_;
+        return *this;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? sum_ / total_ : 0.0; }
+
+    /** The `q`-quantile (e.g., 0.99), as the middle of its bucket. */
+    double quantile(double q) const {
+        if (total_ == 0)
+            return 0.0;
+        uint64_t rank = static_cast<uint64_t>(q * (total_ - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            seen += counts_[b];
+            if (seen >= rank) {
+                double mid = 0.5 * (bucket_begin(b) + bucket_end(b) - 1);
+                return std::min(mid, static_cast<double>(max_));
+            }
+        }
+        return static_cast<double>(max_);
+    }
+};
+
+enum class LatencyOp : int { Predict, Update, NumOps };
+
+constexpr int NUM_LATENCY_OPS = static_cast<int>(LatencyOp::NumOps);
+constexpr int NUM_LENGTH_BUCKETS = 5;
+
+inline const char *latency_op_name(LatencyOp op)
+{ return op == LatencyOp::Predict ? "predict" : "update"; }
+
+/** Length bucket of an email of `num_words` words: <64, <256, <1024,
+ * <4096, and longer. */
+inline int length_bucket(size_t num_words) {
+    int b = 0;
+    for (size_t limit = 64; b < NUM_LENGTH_BUCKETS - 1 && num_words >= limit;
+         limit *= 4)
+        ++b;
+    return b;
+}
+
+/** Smallest number of words in length bucket `b`. */
+inline size_t length_bucket_begin(int b)
+{ return b == 0 ? 0 : size_t(16) << (2 * b); }
+
+struct LatencyStats {
+    LatencyHistogram hist[NUM_LATENCY_OPS][NUM_LENGTH_BUCKETS];
+
+    LatencyStats& operator+=(const LatencyStats& o) {
+        for (int op = 0; op < NUM_LATENCY_OPS; ++op)
+            for (int b = 0; b < NUM_LENGTH_BUCKETS; ++b)
+                hist[op][b] += o.hist[op][b];
+        return *this;
+    }
+
+    /** All lengths of `op` together. */
+    LatencyHistogram total(LatencyOp op) const {
+        LatencyHistogram h;
+        for (int b = 0; b < NUM_LENGTH_BUCKETS; ++b)
+            h += hist[static_cast<int>(op)][b];
+        return h;
+    }
+};
+
+/** The histograms of the calling thread. */
+inline LatencyStats& latency_stats() {
+    thread_local LatencyStats stats;
+    return stats;
+}
+
+/** Records the lifetime of the timer in the histograms of the thread. */
+class LatencyTimer {
+    LatencyOp op_;
+    size_t num_words_;
+    std::chrono::steady_clock::time_point begin_;
+
+public:
+    LatencyTimer(LatencyOp op, size_t num_words)
+        : op_(op), num_words_(num_words), begin_(std::chrono::steady_clock::now()) {}
+
+    ~LatencyTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin_).count();
+        latency_stats().hist[static_cast<int>(op_)][length_bucket(num_words_)]
+            .record(static_cast<uint64_t>(ns));
+    }
+};
+
+/**
+ * Write one line per operation and length bucket (and `all` lengths) with
+ * the number of calls and the mean, p50, p90, p99, p999 and max latency in
+ * nanoseconds.
+ */
+inline void write_latency_percentiles(std::ostream& os, const LatencyStats& stats) {
+    os << "columns=op min_words count mean_ns p50_ns p90_ns p99_ns p999_ns max_ns"
+       << std::endl;
+    auto write = [&](LatencyOp op, const char *min_words, const LatencyHistogram& h) {
+        if (h.count() == 0)
+            return;
+        os << latency_op_name(op) << ' ' << min_words << ' ' << h.count()
+           << ' ' << h.mean() << ' ' << h.quantile(0.5) << ' ' << h.quantile(0.9)
+           << ' ' << h.quantile(0.99) << ' ' << h.quantile(0.999)
+           << ' ' << h.max() << std::endl;
+    };
+    for (int op = 0; op < NUM_LATENCY_OPS; ++op) {
+        LatencyOp o = static_cast<LatencyOp>(op);
+        for (int b = 0; b < NUM_LENGTH_BUCKETS; ++b)
+            write(o, std::to_string(length_bucket_begin(b)).c_str(),
+                  stats.hist[op][b]);
+        write(o, "all", stats.total(o));
+    }
+}
+
+} // namespace bdap
+
+#if BDAP_LATENCY
+#define BDAP_LATENCY_SCOPE(op, num_words) \
+    ::bdap::LatencyTimer BDAP_CONCAT(bdap_latency_timer_, __LINE__)(op, num_words)
+#else
+#define BDAP_LATENCY_SCOPE(op, num_words) ((void)0)
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * Copyright 2023 BDAP team.
+ *
+ * Author: Laurens Devos
+ * Version: 0.2
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "email.hpp"
+#include "corpus_gen.hpp"
+
+namespace bdap {
+
+inline void load_emails(std::vector<Email>& emails, const std::string& fname) {
+    using std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+    using std::chrono::duration_cast;
+
+    std::ifstream f(fname);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file `" << fname << "`, skipping..." << std::endl;
+    } else {
+        steady_clock::time_point begin = steady_clock::now();
+        read_emails(f, emails);
+        steady_clock::time_point end = steady_clock::now();
+
+        std::cout << "Read " << fname << " in "
+            << (duration_cast<milliseconds>(end-begin).count()/1000.0)
+            << "s" << std::endl;
+    }
+}
+
+inline std::vector<Email> load_emails(int seed, const std::vector<std::string>& fnames) {
+    std::vector<Email> emails;
+
+    // Update these paths to your setup, or pass `--corpus <file>`
+    // Data can be found on the departmental computers in /cw/bdap/assignment1
+    if (fnames.empty()) {
+        load_emails(emails, "/cw/bdap/assignment1/Enron.txt");
+        load_emails(emails, "/cw/bdap/assignment1/SpamAssasin.txt");
+        load_emails(emails, "/cw/bdap/assignment1/Trec2005.txt");
+        load_emails(emails, "/cw/bdap/assignment1/Trec2006.txt");
+        load_emails(emails, "/cw/bdap/assignment1/Trec2007.txt");
+    }
+    for (const std::string& fname : fnames)
+        load_emails(emails, fname);
+
+    // Shuffle the emails
+    std::default_random_engine g(seed);
+    std::shuffle(emails.begin(), emails.end(), g);
+
+    return emails;
+}
+
+/** The corpus selected by the `--corpus` / `--synthetic` options of the
+ * executables: `num_synthetic` generated emails if positive, else the
+ * emails in `fnames` (or the default data set if empty). */
+inline std::vector<Email> load_corpus(int seed, const std::vector<std::string>& fnames,
+                                      long long num_synthetic) {
+    if (num_synthetic > 0) {
+        CorpusConfig config;
+        config.seed = seed;
+        return generate_emails(config, num_synthetic);
+    }
+    return load_emails(seed, fnames);
+}
+
+} // namespace bdap
@@ -0,0 +1,228 @@
+/*
+ * A load generator for `bdap_serve`. Every connection sends the emails of
+ * the corpus round-robin, keeping up to `--pipeline` requests in flight, and
+ * measures the latency of every request from just before it is written to
+ * just after its reply is read.
+ *
+ * Usage: ./bdap_loadgen <socket> [--connections <n>] [--requests <n>]
+ *                       [--pipeline <n>] [--feedback-every <k>]
+ *                       [--corpus <file>]... [--synthetic <num-emails>]
+ *
+ * Defaults: 4 connections of 10000 requests each, 8 in flight per
+ * connection, and no feedback. With `--feedback-every k`, every k-th request
+ * is labelled feedback instead of a score request. Without `--corpus`, 2000
+ * synthetic emails are used.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "email.hpp"
+#include "load_emails.hpp"
+#include "serve_protocol.hpp"
+
+using namespace bdap;
+using clock_type = std::chrono::steady_clock;
+
+struct ConnectionResult {
+    std::vector<double> score_us; // latencies in microseconds
+    std::vector<double> feedback_us;
+    size_t num_correct = 0;
+    size_t num_errors = 0;
+};
+
+static int connect_unix(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path too long");
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr),
+                            sizeof(addr)) != 0) {
+        if (fd >= 0)
+            ::close(fd);
+        throw std::runtime_error("failed to connect to `" + path + "`");
+    }
+    return fd;
+}
+
+static void run_connection(const std::string& path,
+                           const std::vector<Email>& emails, size_t offset,
+                           size_t stride, size_t num_requests, size_t pipeline,
+                           size_t feedback_every, ConnectionResult& result) {
+    int fd = connect_unix(path);
+    FdReader in(fd);
+    std::vector<clock_type::time_point> sent(num_requests);
+    std::vector<char> ops(num_requests);
+    std::string out, line;
+    size_t num_sent = 0, num_received = 0;
+
+    while (num_received < num_requests) {
+        while (num_sent < num_requests && num_sent - num_received < pipeline) {
+            const Email& email = emails[(offset + num_sent * stride) % emails.size()];
+            char op = 'P';
+            if (feedback_every > 0 && num_sent % feedback_every == feedback_every - 1)
+                op = email.is_spam() ? 'S' : 'H';
+            out.clear();
+            append_request(out, op, num_sent, email.body());
+            ops[num_sent] = op;
+            sent[num_sent] = clock_type::now();
+            if (!write_all(fd, out))
+                throw std::runtime_error("connection closed by the server");
+            ++num_sent;
+        }
+
+        if (!in.read_line(line))
+            throw std::runtime_error("connection closed by the server");
+        auto now = clock_type::now();
+        std::istringstream ss(line);
+        uint64_t id;
+        std::string what;
+        int label = 0;
+        if (!(ss >> id >> what) || id >= num_sent)
+            throw std::runtime_error("malformed reply `" + line + "`");
+        double us = std::chrono::duration<double, std::micro>(now - sent[id]).count();
+        if (what == "error") {
+            ++result.num_errors;
+        } else if (ops[id] == 'P') {
+            result.score_us.push_back(us);
+            const Email& email = emails[(offset + id * stride) % emails.size()];
+            if (ss >> label && (label == 1) == email.is_spam())
+                ++result.num_correct;
+        } else {
+            result.feedback_us.push_back(us);
+        }
+        ++num_received;
+    }
+    ::close(fd);
+}
+
+/** `q`-quantile of sorted `xs`. */
+static double quantile(const std::vector<double>& xs, double q) {
+    if (xs.empty())
+        return 0.0;
+    size_t i = static_cast<size_t>(q * (xs.size() - 1) + 0.5);
+    return xs[std::min(i, xs.size() - 1)];
+}
+
+static void print_latencies(const std::string& name, std::vector<double>& us) {
+    std::sort(us.begin(), us.end());
+    std::cout << name << " latency (us): n " << us.size()
+              << ", p50 " << quantile(us, 0.5)
+              << ", p99 " << quantile(us, 0.99)
+              << ", p999 " << quantile(us, 0.999)
+              << ", max " << (us.empty() ? 0.0 : us.back()) << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: ./bdap_loadgen <socket> [--connections <n>]"
+                     " [--requests <n>] [--pipeline <n>] [--feedback-every <k>]"
+                     " [--corpus <file>]... [--synthetic <num-emails>]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string socketpath{argv[1]};
+    long connections = 4;
+    long requests = 10000;
+    long pipeline = 8;
+    long feedback_every = 0;
+    std::vector<std::string> corpusfnames;
+    long long num_synthetic = 0;
+
+    for (int i = 2; i < argc; i += 2) {
+        std::string opt{argv[i]};
+        if (i+1 >= argc) {
+            std::cerr << "Missing value for " << opt << std::endl;
+            return 1;
+        } else if (opt == "--connections") {
+            connections = std::atol(argv[i+1]);
+        } else if (opt == "--requests") {
+            requests = std::atol(argv[i+1]);
+        } else if (opt == "--pipeline") {
+            pipeline = std::atol(argv[i+1]);
+        } else if (opt == "--feedback-every") {
+            feedback_every = std::atol(argv[i+1]);
+        } else if (opt == "--corpus") {
+            corpusfnames.push_back(argv[i+1]);
+        } else if (opt == "--synthetic") {
+            num_synthetic = std::atoll(argv[i+1]);
+        } else {
+            std::cerr << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    if (connections <= 0 || requests <= 0 || pipeline <= 0 || feedback_every < 0) {
+        std::cerr << "Invalid load options" << std::endl;
+        return 2;
+    }
+
+    if (corpusfnames.empty() && num_synthetic <= 0)
+        num_synthetic = 2000;
+    std::vector<Email> emails = load_corpus(13, corpusfnames, num_synthetic);
+    if (emails.empty()) {
+        std::cerr << "No emails" << std::endl;
+        return 3;
+    }
+
+    std::vector<ConnectionResult> results(connections);
+    std::vector<std::thread> threads;
+    std::vector<std::string> errors(connections);
+    auto begin = clock_type::now();
+    for (long c = 0; c < connections; ++c) {
+        threads.emplace_back([&, c]() {
+            try {
+                run_connection(socketpath, emails, c, connections, requests,
+                               pipeline, feedback_every, results[c]);
+            } catch (const std::exception& e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(clock_type::now() - begin).count();
+
+    for (const std::string& error : errors) {
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+            return 4;
+        }
+    }
+
+    ConnectionResult all;
+    for (const ConnectionResult& r : results) {
+        all.score_us.insert(all.score_us.end(), r.score_us.begin(), r.score_us.end());
+        all.feedback_us.insert(all.feedback_us.end(), r.feedback_us.begin(),
+                               r.feedback_us.end());
+        all.num_correct += r.num_correct;
+        all.num_errors += r.num_errors;
+    }
+    size_t total = all.score_us.size() + all.feedback_us.size() + all.num_errors;
+    std::cout << "requests: " << total << " in " << seconds << "s, "
+              << total / seconds << " QPS, " << all.num_errors << " errors"
+              << std::endl;
+    print_latencies("score", all.score_us);
+    if (!all.feedback_us.empty())
+        print_latencies("feedback", all.feedback_us);
+    std::cout << "accuracy: "
+              << (all.score_us.empty() ? 0.0
+                  : double(all.num_correct) / all.score_us.size())
+              << std::endl;
+    return 0;
+}
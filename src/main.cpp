@@ -5,17 +5,24 @@
  * Version: 0.2
  */
 
+#define BDAP_ALLOC_TRACKER_IMPL // this TU defines the tracking operator new
+
 #include <algorithm>
-#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <random>
 #include <stdexcept>
 #include <vector>
 
+#include "alloc_tracker.hpp"
 #include "email.hpp"
 #include "metric.hpp"
 #include "base_classifier.hpp"
+#include "corpus_gen.hpp"
+#include "load_emails.hpp"
+#include "latency.hpp"
+#include "profile.hpp"
+#include "stream.hpp"
 
 #include "naive_bayes_feature_hashing.hpp"
 #include "perceptron_feature_hashing.hpp"
@@ -24,69 +31,11 @@
 
 using namespace bdap;
 
-using std::chrono::steady_clock;
-using std::chrono::milliseconds;
-using std::chrono::duration_cast;
-
-void load_emails(std::vector<Email>& emails, const std::string& fname) {
-    std::ifstream f(fname);
-    if (!f.is_open()) {
-        std::cerr << "Failed to open file `" << fname << "`, skipping..." << std::endl;
-    } else {
-        steady_clock::time_point begin = steady_clock::now();
-        read_emails(f, emails);
-        steady_clock::time_point end = steady_clock::now();
-
-        std::cout << "Read " << fname << " in "
-            << (duration_cast<milliseconds>(end-begin).count()/1000.0)
-            << "s" << std::endl;
-    }
-}
-
-std::vector<Email> load_emails(int seed) {
-    std::vector<Email> emails;
-
-    // Update these paths to your setup
-    // Data can be found on the departmental computers in /cw/bdap/assignment1
-    load_emails(emails, "/cw/bdap/assignment1/Enron.txt");
-    load_emails(emails, "/cw/bdap/assignment1/SpamAssasin.txt");
-    load_emails(emails, "/cw/bdap/assignment1/Trec2005.txt");
-    load_emails(emails, "/cw/bdap/assignment1/Trec2006.txt");
-    load_emails(emails, "/cw/bdap/assignment1/Trec2007.txt");
-
-    // Shuffle the emails
-    std::default_random_engine g(seed);
-    std::shuffle(emails.begin(), emails.end(), g);
-
-    return emails;
-}
-
-/**
- * This function emulates a stream of emails. Every `window` examples, the
- * metric is evaluated and the score is recorded. Use the results of this
- * function to plot your learning curves.
- */
-template <typename Clf, typename Metric>
-std::vector<double>
-stream_emails(const std::vector<Email> &emails,
-              Clf& clf, Metric& metric, int window) {
-    std::vector<double> metric_values;
-    for (size_t i = 0; i < emails.size(); i+=window) {
-        for (size_t u = 0; u < window && i+u < emails.size(); ++u)
-            metric.evaluate(clf, emails[i+u]);
-
-        double score = metric.get_score();
-        metric_values.push_back(score);
-
-        for (size_t u = 0; u < window && i+u < emails.size(); ++u)
-            clf.update(emails[i+u]);
-    }
-    return metric_values;
-}
-
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
+    if (argc < 4 || argc % 2 != 0) {
         std::cerr << "Usage: ./bdap_assignment1 <window-size> <ngram> <output-file>"
+                     " [--corpus <file>]... [--synthetic <num-emails>]"
+                     " [--snapshot <file>]"
                   << std::endl;
         return 1;
     }
@@ -94,6 +43,23 @@ int main(int argc, char *argv[]) {
     int window = std::atoi(argv[1]);
     int ngram = std::atoi(argv[2]);
     std::string outfname{argv[3]};
+    std::vector<std::string> corpusfnames;
+    long long num_synthetic = 0;
+    std::string snapshotfname;
+
+    for (int i = 4; i < argc; i += 2) {
+        std::string opt{argv[i]};
+        if (opt == "--corpus") {
+            corpusfnames.push_back(argv[i+1]);
+        } else if (opt == "--synthetic") {
+            num_synthetic = std::atoll(argv[i+1]);
+        } else if (opt == "--snapshot") {
+            snapshotfname = argv[i+1];
+        } else {
+            std::cerr << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
 
     if (window <= 0) {
         std::cerr << "Invalid window size " << window << std::endl;
@@ -110,8 +76,22 @@ int main(int argc, char *argv[]) {
     std::cout << "outfile: " << outfname << std::endl;
 
     int seed = 12;
-    std::vector<Email> emails = load_emails(seed);
+#if BDAP_TRACK_ALLOCS
+    AllocStats load_allocs = thread_alloc_stats();
+#endif
+    std::vector<Email> emails = load_corpus(seed, corpusfnames, num_synthetic);
     std::cout << "#emails: " << emails.size() << std::endl;
+#if BDAP_TRACK_ALLOCS
+    {
+        AllocStats allocs = thread_alloc_stats();
+        allocs -= load_allocs;
+        std::cout << "load allocs: "
+                  << (static_cast<double>(allocs.allocs) / emails.size())
+                  << "/email, "
+                  << (static_cast<double>(allocs.bytes) / emails.size())
+                  << " bytes/email" << std::endl;
+    }
+#endif
     size_t num_spam = 0;
     for (const Email& e : emails)
         num_spam += e.is_spam();
@@ -119,20 +99,60 @@ int main(int argc, char *argv[]) {
               << (100.0 * num_spam / emails.size()) << "%"
               << std::endl;
 
-    Accuracy metric;
+#if BDAP_PROFILE
+    for (Phase phase : {Phase::Parse, Phase::Tokenize})
+        std::cout << phase_name(phase) << ": "
+                  << phase_stats().count[static_cast<int>(phase)] << " calls, "
+                  << (phase_stats().ns[static_cast<int>(phase)] / 1e9) << "s"
+                  << std::endl;
+#endif
+
+    // accuracy, precision, recall, F1 and error, cumulative, over the last
+    // window and exponentially faded, all from a single prediction per email
+    using Metric = MultiMetric<ConfusionMatrix, SlidingConfusionMatrix,
+                               FadedConfusionMatrix>;
+    Metric metric{ConfusionMatrix{}, SlidingConfusionMatrix(window),
+                  FadedConfusionMatrix(window)};
     // PerceptronFeatureHashing clf{ngram, 10, 0.001};
     PerceptronCountMin clf{ ngram, 5, 10, 0.001 };
     //NaiveBayesFeatureHashing clf{ngram, 20};
     //NaiveBayesCountMin clf{ ngram, 10, 15 };
-    auto metric_values = stream_emails(emails, clf, metric, window);
+    std::cout << "model: " << clf.memory_bytes() << " bytes" << std::endl;
+#if BDAP_PERF_COUNTERS
+    {
+        PerfCounters probe;
+        if (!probe.available())
+            std::cerr << "perf counters unavailable: " << probe.error() << std::endl;
+    }
+#endif
+
+    std::vector<WindowStats> stats;
+    auto metric_values = stream_emails(emails, clf, metric, window, stats);
+#if BDAP_PERF_COUNTERS
+    print_perf_summary(std::cout, stats);
+#endif
+#if BDAP_TRACK_ALLOCS
+    print_alloc_summary(std::cout, stats);
+#endif
 
     // write out the results
     std::ofstream outfile{outfname};
-    outfile << "window=" << window << std::endl;
-    outfile << "ngram=" << ngram << std::endl;
-    outfile << "#emails=" << emails.size() << std::endl;
-    for (double metric_value : metric_values)
-        outfile << metric_value << std::endl;
+    write_results(outfile, window, ngram, emails.size(), metric_values, stats,
+                  Metric::score_names());
+#if BDAP_LATENCY
+    {
+        std::ofstream latencyfile{outfname + ".latency.txt"};
+        write_latency_percentiles(latencyfile, latency_stats());
+        std::cout << "latency: " << outfname << ".latency.txt" << std::endl;
+    }
+#endif
+
+    // write out the trained model, for use with `MappedModel`
+    if (!snapshotfname.empty()) {
+        std::ofstream snapshotfile{snapshotfname, std::ios::binary};
+        clf.save(snapshotfile);
+        std::cout << "snapshot: " << snapshotfname << std::endl;
+    }
 
     // just for fun, evaluate a single email:
     // clf.printValues();
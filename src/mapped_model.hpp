@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "email.hpp"
+#include "base_classifier.hpp"
+#include "snapshot.hpp"
+#include "sparse_model.hpp"
+
+namespace bdap {
+
+/**
+ * A read-only, shared memory mapping of a file.
+ *
+ * The mapping is shared, so all processes that map the same snapshot share
+ * the same physical pages through the page cache.
+ */
+class FileMapping {
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+
+public:
+    explicit FileMapping(const std::string& fname) {
+#if defined(_WIN32)
+        file_ = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("failed to open `" + fname + "`");
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            release();
+            throw std::runtime_error("failed to stat `" + fname + "`");
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0,
+                                      nullptr);
+        if (mapping_ != nullptr)
+            data_ = static_cast<const char *>(
+                    MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) {
+            release();
+            throw std::runtime_error("failed to map `" + fname + "`");
+        }
+#else
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("failed to open `" + fname + "`");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to stat `" + fname + "`");
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if (p == MAP_FAILED)
+            throw std::runtime_error("failed to map `" + fname + "`");
+        data_ = static_cast<const char *>(p);
+#endif
+    }
+
+    FileMapping(FileMapping&& o) noexcept { swap(o); }
+    FileMapping& operator=(FileMapping&& o) noexcept { swap(o); return *this; }
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+    ~FileMapping() { release(); }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void swap(FileMapping& o) noexcept {
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+#if defined(_WIN32)
+        std::swap(file_, o.file_);
+        std::swap(mapping_, o.mapping_);
+#endif
+    }
+
+    void release() {
+#if defined(_WIN32)
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) ::munmap(const_cast<char *>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+};
+
+/**
+ * A read-only classifier that scores directly from a memory mapped model
+ * snapshot (see `snapshot.hpp` and the `save` methods of the classifiers).
+ *
+ * Nothing is copied out of the mapping: construction is a single `mmap` plus
+ * a header check, and pages are faulted in lazily on first use. Predictions
+ * are identical to those of the classifier that wrote the snapshot.
+ */
+class MappedModel : public BaseClf<MappedModel> {
+    FileMapping mapping_;
+    SnapshotHeader header_;
+    const char *table_;
+    size_t mask_;
+
+public:
+    explicit MappedModel(const std::string& fname)
+        : MappedModel(FileMapping(fname)) {}
+
+    const SnapshotHeader& header() const { return header_; }
+    ModelKind kind() const { return header_.kind; }
+    int ngram() const { return header_.ngram; }
+
+    /** Size of the mapped tables in bytes. These pages live in the page cache
+     * and are shared by all processes that map the same snapshot. */
+    size_t memory_bytes() const { return header_.table_bytes; }
+
+    void update_(const Email&) {
+        throw std::logic_error("MappedModel is read-only");
+    }
+
+    double predict_(const Email& email) const {
+        switch (header_.kind) {
+        case ModelKind::NaiveBayesFeatureHashing:
+        case ModelKind::NaiveBayesCountMin:
+            return predict_naive_bayes(email);
+        case ModelKind::PerceptronFeatureHashing:
+            return predict_perceptron_fh(email);
+        case ModelKind::PerceptronCountMin:
+            return predict_perceptron_cm(email);
+        case ModelKind::SparseFeatureHashing:
+            return predict_sparse(email);
+        }
+        return 0.0;
+    }
+
+private:
+    explicit MappedModel(FileMapping&& mapping)
+        : BaseClf(read_header(mapping).threshold)
+        , mapping_(std::move(mapping))
+        , header_(read_header(mapping_))
+        , table_(mapping_.data() + header_.table_offset)
+        , mask_(header_.num_buckets() - 1)
+    {}
+
+    static SnapshotHeader read_header(const FileMapping& mapping) {
+        SnapshotHeader header;
+        if (mapping.size() < sizeof(header))
+            throw std::runtime_error("truncated model snapshot");
+        std::memcpy(&header, mapping.data(), sizeof(header));
+        header.validate(mapping.size());
+        header.check_hash(hash_kind);
+        return header;
+    }
+
+    template <typename T>
+    const T *row(int i) const {
+        return reinterpret_cast<const T *>(table_ + i * header_.row_bytes());
+    }
+
+    int32_t nb_count(std::string_view ngram, int is_spam) const {
+        if (header_.kind == ModelKind::NaiveBayesFeatureHashing) {
+            size_t bucket = (hash(ngram, header_.seed) & mask_) * 2 + is_spam;
+            return row<int32_t>(0)[bucket];
+        }
+        int32_t min = row<int32_t>(0)[(hash(ngram, 0) & mask_) * 2 + is_spam];
+        for (int i = 1; i < header_.num_hashes; ++i) {
+            int32_t c = row<int32_t>(i)[(hash(ngram, i) & mask_) * 2 + is_spam];
+            if (c < min)
+                min = c;
+        }
+        return min;
+    }
+
+    double predict_naive_bayes(const Email& email) const {
+        double result = std::log(header_.n_spam / header_.n_ham);
+        EmailIter allngrams(email, header_.ngram);
+        std::string_view ngram;
+        while (allngrams) {
+            ngram = allngrams.next();
+            result += std::log(((double)nb_count(ngram, 1) / header_.n_spam_grams)
+                    / ((double)nb_count(ngram, 0) / header_.n_ham_grams));
+        }
+        result = std::exp(result);
+        return result / (1 + result);
+    }
+
+    double predict_perceptron_fh(const Email& email) const {
+        const double *weights = row<double>(0);
+        EmailIter allngrams(email, header_.ngram);
+        double h = 0.0;
+        while (allngrams)
+            h += weights[hash(allngrams.next(), header_.seed) & mask_];
+        return tanh(h);
+    }
+
+    double predict_perceptron_cm(const Email& email) const {
+        EmailIter allngrams(email, header_.ngram);
+        double h = 0.0;
+        double h_i = 0.0;
+        std::string_view ngram;
+        while (allngrams) {
+            ngram = allngrams.next();
+            for (int i = 0; i < header_.num_hashes; i++)
+                h_i += row<double>(i)[hash(ngram, i) & mask_];
+            h += h_i / header_.num_hashes;
+            h_i = 0.0;
+        }
+        return tanh(h);
+    }
+
+    double predict_sparse(const Email& email) const {
+        const SparseEntry *begin = row<SparseEntry>(0);
+        const SparseEntry *end = begin + header_.num_entries;
+        EmailIter allngrams(email, header_.ngram);
+        double a = 0.0;
+        while (allngrams) {
+            uint64_t bucket = hash(allngrams.next(), header_.seed) & mask_;
+            const SparseEntry *e = std::lower_bound(begin, end, bucket,
+                    [](const SparseEntry& e, uint64_t b) { return e.bucket < b; });
+            a += (e != end && e->bucket == bucket) ? e->weight : 0.0;
+        }
+        return sigmoid(a);
+    }
+};
+
+} // namespace bdap
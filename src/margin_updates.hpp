@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * Margin-based updates of the perceptrons: skip the write phase of `update`
+ * for emails that the model already classifies correctly with a margin, i.e.,
+ * with label `y` (+1 for spam, -1 for ham) and activation `a` (the sum that
+ * `predict` passes through `tanh`), when `y * a >= margin`.
+ *
+ * The forward pass of `update` computes `a` anyway, so a skipped update costs
+ * about as much as a `predict`. Once the model fits the stream, most updates
+ * are skipped.
+ *
+ * With `aggressiveness > 0`, the emails that are not skipped get a
+ * passive-aggressive step (PA-I) instead of the gradient step with the
+ * learning rate: the smallest change to the weights that reaches the margin,
+ * `tau = min(aggressiveness, (margin - y * a) / |x|^2)` along `y * x`, with `x`
+ * the n-gram counts per bucket.
+ */
+struct MarginUpdates {
+    bool enabled = false;
+    double margin = 1.0;
+    double aggressiveness = 0.0; // 0: gradient steps with the learning rate
+
+    bool skip(int y, double a) const { return enabled && y * a >= margin; }
+
+    bool passive_aggressive() const { return enabled && aggressiveness > 0.0; }
+
+    /** The PA-I step size, for `sq_norm = |x|^2`. */
+    double pa_step(int y, double a, double sq_norm) const {
+        if (sq_norm <= 0.0)
+            return 0.0;
+        return std::min(aggressiveness, (margin - y * a) / sq_norm);
+    }
+};
+
+/** The squared norm of the count vector of `buckets` (a bucket per n-gram
+ * occurrence): the sum of the squared counts. Sorts `buckets`. */
+inline double sum_sq_counts(std::vector<int>& buckets) {
+    std::sort(buckets.begin(), buckets.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < buckets.size();) {
+        size_t j = i;
+        while (j < buckets.size() && buckets[j] == buckets[i])
+            ++j;
+        sum += double(j - i) * double(j - i);
+        i = j;
+    }
+    return sum;
+}
+
+} // namespace bdap
@@ -1,3 +1,13 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include "email.hpp"
 
 namespace bdap {
@@ -52,7 +62,7 @@ namespace bdap {
             }
         }
 
-        double get_precision() const { return tr_pos / pr_pos; }
+        double get_precision() const { return static_cast<double>(tr_pos) / pr_pos; }
         double get_error() const { return 1.0 - get_precision(); }
 
         double get_score() const { return get_precision(); }
@@ -82,13 +92,184 @@ namespace bdap {
             }
         }
 
-        double get_precision() const { return tr_pos / pos; }
+        double get_precision() const { return static_cast<double>(tr_pos) / pos; }
         double get_error() const { return 1.0 - get_precision(); }
 
         double get_score() const { return get_precision(); }
     };
 
-    struct ConfusionMatrix {
+    /**
+     * The four cells of a confusion matrix, spam being the positive class,
+     * and the scores derived from them. `T` is `int` for plain counts and
+     * `double` for exponentially faded counts.
+     */
+    template <typename T>
+    struct ConfusionCounts {
+        T tp = 0;
+        T fp = 0;
+        T tn = 0;
+        T fn = 0;
+
+        T n() const { return tp + fp + tn + fn; }
+
+        double get_accuracy() const { return static_cast<double>(tp + tn) / n(); }
+        double get_precision() const { return static_cast<double>(tp) / (tp + fp); }
+        double get_recall() const { return static_cast<double>(tp) / (tp + fn); }
+        double get_f1() const { return 2.0 * tp / (2.0 * tp + fp + fn); }
+        double get_error() const { return 1.0 - get_accuracy(); }
+
+        double get_score() const { return get_accuracy(); }
+
+        static std::vector<std::string> score_names()
+        { return {"accuracy", "precision", "recall", "f1", "error"}; }
+
+        std::vector<double> get_scores() const {
+            return {get_accuracy(), get_precision(), get_recall(), get_f1(),
+                    get_error()};
+        }
+
+    protected:
+        static std::vector<std::string> prefixed(const std::string& prefix) {
+            std::vector<std::string> names = score_names();
+            for (std::string& name : names)
+                name = prefix + name;
+            return names;
+        }
+    };
+
+    /**
+     * Confusion matrix of the hard classifications. A single prediction per
+     * email updates all four cells, from which accuracy, precision, recall,
+     * F1 and error are derived.
+     */
+    struct ConfusionMatrix : ConfusionCounts<int> {
+        template <typename Clf>
+        void evaluate(const Clf& clf, const std::vector<Email>& emails)
+        {
+            for (const Email& email : emails)
+                evaluate(clf, email);
+        }
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const Email& email) {
+            double pr = clf.predict(email);
+            observe(email.is_spam(), pr, clf.classify(pr));
+        }
+
+        void observe(bool lab, double, bool pred) {
+            tp += static_cast<int>(lab && pred);
+            fp += static_cast<int>(!lab && pred);
+            tn += static_cast<int>(!lab && !pred);
+            fn += static_cast<int>(lab && !pred);
+        }
+    };
+
+    /**
+     * Confusion matrix over the last `size` emails only, so that late-stream
+     * drift is not averaged away. A ring buffer keeps the outcome of each
+     * email in the window; adding an email evicts the oldest one, so the
+     * update is O(1).
+     */
+    struct SlidingConfusionMatrix : ConfusionCounts<int> {
+        std::vector<uint8_t> ring; // outcome = 2*lab + pred
+        size_t next = 0;
+        size_t filled = 0;
+
+        explicit SlidingConfusionMatrix(size_t size) : ring(size, 0) {
+            if (size == 0)
+                throw std::invalid_argument("empty sliding window");
+        }
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const std::vector<Email>& emails)
+        {
+            for (const Email& email : emails)
+                evaluate(clf, email);
+        }
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const Email& email) {
+            double pr = clf.predict(email);
+            observe(email.is_spam(), pr, clf.classify(pr));
+        }
+
+        void observe(bool lab, double, bool pred) {
+            if (filled == ring.size())
+                cell(ring[next]) -= 1;
+            else
+                ++filled;
+            uint8_t outcome = static_cast<uint8_t>(2 * lab + pred);
+            ring[next] = outcome;
+            cell(outcome) += 1;
+            if (++next == ring.size())
+                next = 0;
+        }
+
+        static std::vector<std::string> score_names()
+        { return prefixed("sliding_"); }
+
+    private:
+        int& cell(uint8_t outcome) {
+            switch (outcome) {
+            case 0: return tn;
+            case 1: return fp;
+            case 2: return fn;
+            default: return tp;
+            }
+        }
+    };
+
+    /**
+     * Exponentially faded confusion matrix: every new email multiplies the
+     * weight of all previous emails by `alpha`, so an email's weight halves
+     * every `half_life` emails.
+     */
+    struct FadedConfusionMatrix : ConfusionCounts<double> {
+        double alpha;
+
+        explicit FadedConfusionMatrix(double half_life)
+            : alpha(std::pow(0.5, 1.0 / half_life)) {}
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const std::vector<Email>& emails)
+        {
+            for (const Email& email : emails)
+                evaluate(clf, email);
+        }
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const Email& email) {
+            double pr = clf.predict(email);
+            observe(email.is_spam(), pr, clf.classify(pr));
+        }
+
+        void observe(bool lab, double, bool pred) {
+            tp = alpha * tp + static_cast<double>(lab && pred);
+            fp = alpha * fp + static_cast<double>(!lab && pred);
+            tn = alpha * tn + static_cast<double>(!lab && !pred);
+            fn = alpha * fn + static_cast<double>(lab && !pred);
+        }
+
+        static std::vector<std::string> score_names()
+        { return prefixed("faded_"); }
+    };
+
+    /**
+     * Streaming ROC/AUC over a fixed-bin histogram of the soft predictions,
+     * one histogram per class. Memory is O(bins), independent of the number
+     * of emails, and histograms of different threads (or streams) can be
+     * merged. Thresholds are resolved up to the bin width: pick [lo, hi] to
+     * cover the range of `predict` ([0, 1] for Naive Bayes, [-1, 1] for the
+     * perceptrons); scores outside are clamped into the first or last bin.
+     */
+    struct RocHistogram {
+        double lo;
+        double hi;
+        std::vector<uint64_t> pos; // spam counts per bin
+        std::vector<uint64_t> neg; // ham counts per bin
+
+        RocHistogram(double lo = 0.0, double hi = 1.0, size_t bins = 1000)
+            : lo(lo), hi(hi), pos(bins, 0), neg(bins, 0) {}
 
         template <typename Clf>
         void evaluate(const Clf& clf, const std::vector<Email>& emails)
@@ -98,11 +279,143 @@ namespace bdap {
         }
 
         template <typename Clf>
-        void evaluate(const Clf& clf, Email& emails) {
+        void evaluate(const Clf& clf, const Email& email) {
+            double pr = clf.predict(email);
+            observe(email.is_spam(), pr, clf.classify(pr));
+        }
+
+        void observe(bool lab, double pr, bool) {
+            ++(lab ? pos : neg)[bin(pr)];
+        }
+
+        void merge(const RocHistogram& o) {
+            if (o.lo != lo || o.hi != hi || o.pos.size() != pos.size())
+                throw std::invalid_argument("incompatible ROC histograms");
+            for (size_t b = 0; b < pos.size(); ++b) {
+                pos[b] += o.pos[b];
+                neg[b] += o.neg[b];
+            }
+        }
+
+        size_t num_bins() const { return pos.size(); }
+
+        /** Lower edge of bin `b`: classifying `pr >= threshold(b)` as spam
+         * predicts all emails in bins b, b+1, ... as spam. */
+        double threshold(size_t b) const
+        { return lo + (hi - lo) * static_cast<double>(b) / num_bins(); }
+
+        size_t bin(double pr) const {
+            double x = (pr - lo) / (hi - lo) * num_bins();
+            if (!(x >= 0.0)) return 0; // also NaN
+            return std::min(static_cast<size_t>(x), num_bins() - 1);
+        }
+
+        /** Area under the ROC curve. Scores that share a bin count as ties. */
+        double get_auc() const {
+            double p = 0.0, n = 0.0, auc = 0.0;
+            for (size_t b = 0; b < num_bins(); ++b) {
+                // pairs (spam, ham) with the spam email in a higher bin
+                auc += pos[b] * (n + 0.5 * neg[b]);
+                p += pos[b];
+                n += neg[b];
+            }
+            return auc / (p * n);
+        }
 
+        double get_score() const { return get_auc(); }
+
+        static std::vector<std::string> score_names() { return {"auc"}; }
+        std::vector<double> get_scores() const { return {get_auc()}; }
+
+        struct Operating {
+            double threshold;
+            double tpr;       // = recall
+            double fpr;
+            double precision;
+            double f1;
+        };
+
+        /** The operating point of every bin threshold, in ascending order. */
+        std::vector<Operating> sweep() const {
+            uint64_t p_total = 0, n_total = 0;
+            for (size_t b = 0; b < num_bins(); ++b) {
+                p_total += pos[b];
+                n_total += neg[b];
+            }
+            std::vector<Operating> points(num_bins());
+            uint64_t tp = 0, fp = 0;
+            for (size_t b = num_bins(); b-- > 0; ) {
+                tp += pos[b];
+                fp += neg[b];
+                Operating& o = points[b];
+                o.threshold = threshold(b);
+                o.tpr = static_cast<double>(tp) / p_total;
+                o.fpr = static_cast<double>(fp) / n_total;
+                o.precision = static_cast<double>(tp) / (tp + fp);
+                o.f1 = 2.0 * tp / (p_total + tp + fp);
+            }
+            return points;
         }
 
+        /** The bin threshold with the highest F1 score. */
+        Operating best_f1() const {
+            std::vector<Operating> points = sweep();
+            return *std::max_element(points.begin(), points.end(),
+                    [](const Operating& a, const Operating& b) {
+                        return a.f1 < b.f1;
+                    });
+        }
     };
 
+    /**
+     * Several metrics evaluated from one prediction per email: `evaluate`
+     * predicts once and passes the label, the soft prediction and the hard
+     * classification to the `observe` of every metric. The primary score is
+     * that of the first metric; `get_scores` concatenates all scores.
+     */
+    template <typename... Metrics>
+    struct MultiMetric {
+        std::tuple<Metrics...> metrics;
+
+        explicit MultiMetric(Metrics... ms) : metrics(std::move(ms)...) {}
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const std::vector<Email>& emails)
+        {
+            for (const Email& email : emails)
+                evaluate(clf, email);
+        }
+
+        template <typename Clf>
+        void evaluate(const Clf& clf, const Email& email) {
+            double pr = clf.predict(email);
+            observe(email.is_spam(), pr, clf.classify(pr));
+        }
+
+        void observe(bool lab, double pr, bool pred) {
+            std::apply([&](auto&... m) { (m.observe(lab, pr, pred), ...); },
+                       metrics);
+        }
+
+        double get_score() const { return std::get<0>(metrics).get_score(); }
+
+        static std::vector<std::string> score_names() {
+            std::vector<std::string> names;
+            (append(names, Metrics::score_names()), ...);
+            return names;
+        }
+
+        std::vector<double> get_scores() const {
+            std::vector<double> scores;
+            std::apply([&](const auto&... m) { (append(scores, m.get_scores()), ...); },
+                       metrics);
+            return scores;
+        }
+
+    private:
+        template <typename T>
+        static void append(std::vector<T>& v, const std::vector<T>& w)
+        { v.insert(v.end(), w.begin(), w.end()); }
+    };
 
 } // namespace bdap
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * A multi-producer queue whose consumer takes items in batches.
+ *
+ * `pop_batch` returns as soon as `max_batch` items are queued, or once the
+ * oldest queued item has waited `max_wait`, whichever comes first. Under low
+ * load a request is therefore delayed by at most `max_wait`; under high load
+ * the consumer takes full batches without waiting, and amortizes its
+ * per-batch costs (wake-ups, locks, reply writes) over many items.
+ */
+template <typename T>
+class MicroBatcher {
+    using clock = std::chrono::steady_clock;
+
+    size_t max_batch_;
+    clock::duration max_wait_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<clock::time_point, T>> queue_; // with arrival time
+    bool closed_ = false;
+
+public:
+    MicroBatcher(size_t max_batch, clock::duration max_wait)
+        : max_batch_(max_batch > 0 ? max_batch : 1), max_wait_(max_wait) {}
+
+    void push(T item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.emplace_back(clock::now(), std::move(item));
+        if (queue_.size() == 1 || queue_.size() == max_batch_)
+            cv_.notify_one();
+    }
+
+    /** Let `pop_batch` return the remaining items without waiting, and then
+     * false. */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        cv_.notify_all();
+    }
+
+    /** Replace the contents of `batch` by the next batch, which is never
+     * empty. Returns false only when the batcher is closed and empty. */
+    bool pop_batch(std::vector<T>& batch) {
+        batch.clear();
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+            if (queue_.empty())
+                return false;
+            cv_.wait_until(lock, queue_.front().first + max_wait_, [this]() {
+                return queue_.size() >= max_batch_ || closed_;
+            });
+            // with several consumers, another one may have taken the item this
+            // one waited for: then wait again, for the new front
+            if (closed_ || queue_.size() >= max_batch_ || (!queue_.empty()
+                    && clock::now() >= queue_.front().first + max_wait_))
+                break;
+        }
+        if (queue_.empty())
+            return false;
+        while (!queue_.empty() && batch.size() < max_batch_) {
+            batch.push_back(std::move(queue_.front().second));
+            queue_.pop_front();
+        }
+        if (!queue_.empty())
+            cv_.notify_one(); // the rest is for another consumer
+        return true;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+};
+
+} // namespace bdap
@@ -0,0 +1,107 @@
+/*
+ * Trains and evaluates several classifiers side by side on one pass over the
+ * corpus. Each email is tokenized and hashed once for all models.
+ *
+ * Usage: ./bdap_multi <window-size> <output-prefix> <model>...
+ *                     [--corpus <file>]... [--synthetic <num-emails>]
+ *
+ * Models are given as in `ClfConfig::parse`, e.g., `nbfh:2:20` or
+ * `pcm:2:5:10:0.001`. The learning curve of each model is written to
+ * `<output-prefix>.<model>.txt`, in the format of `bdap_assignment1`.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "any_classifier.hpp"
+#include "email.hpp"
+#include "load_emails.hpp"
+#include "metric.hpp"
+#include "multi_model.hpp"
+#include "stream.hpp"
+
+using namespace bdap;
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: ./bdap_multi <window-size> <output-prefix> <model>..."
+                     " [--corpus <file>]... [--synthetic <num-emails>]"
+                  << std::endl;
+        return 1;
+    }
+
+    int window = std::atoi(argv[1]);
+    std::string outprefix{argv[2]};
+    std::vector<ClfConfig> configs;
+    std::vector<std::string> corpusfnames;
+    long long num_synthetic = 0;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string arg{argv[i]};
+        if ((arg == "--corpus" || arg == "--synthetic") && i+1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        } else if (arg == "--corpus") {
+            corpusfnames.push_back(argv[++i]);
+        } else if (arg == "--synthetic") {
+            num_synthetic = std::atoll(argv[++i]);
+        } else {
+            try {
+                configs.push_back(ClfConfig::parse(arg));
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (window <= 0) {
+        std::cerr << "Invalid window size " << window << std::endl;
+        return 2;
+    }
+
+    if (configs.empty()) {
+        std::cerr << "No models given" << std::endl;
+        return 3;
+    }
+
+    int seed = 12;
+    std::vector<Email> emails = load_corpus(seed, corpusfnames, num_synthetic);
+    std::cout << "#emails: " << emails.size() << std::endl;
+
+    using Metric = MultiMetric<ConfusionMatrix, SlidingConfusionMatrix,
+                               FadedConfusionMatrix>;
+    std::vector<ModelRun<Metric>> runs;
+    runs.reserve(configs.size());
+    for (const ClfConfig& config : configs)
+        runs.emplace_back(config, Metric{ConfusionMatrix{},
+                                         SlidingConfusionMatrix(window),
+                                         FadedConfusionMatrix(window)});
+
+    double hash_seconds = stream_emails_shared(emails, runs, window);
+    std::cout << "hashing: " << hash_seconds << "s (shared by "
+              << runs.size() << " models)" << std::endl;
+
+    for (const ModelRun<Metric>& run : runs) {
+        std::string name = run.clf.config().name();
+        double seconds = 0.0;
+        for (const WindowStats& ws : run.stats)
+            seconds += ws.seconds;
+
+        std::string outfname = outprefix + "." + name + ".txt";
+        std::ofstream outfile{outfname};
+        write_results(outfile, window, run.clf.ngram(), emails.size(),
+                      run.metric_values, run.stats, Metric::score_names());
+
+        std::cout << name << ": accuracy " << run.metric.get_score()
+                  << ", " << seconds << "s, "
+                  << run.clf.memory_bytes() << " bytes -> " << outfname
+                  << std::endl;
+    }
+
+    return 0;
+}
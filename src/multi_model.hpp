@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include "any_classifier.hpp"
+#include "email.hpp"
+#include "hashed_email.hpp"
+#include "profile.hpp"
+#include "stream.hpp"
+
+namespace bdap {
+
+/** One classifier of a multi-model run, with its own metric and results. */
+template <typename Metric>
+struct ModelRun {
+    AnyClf clf;
+    Metric metric;
+    std::vector<double> metric_values;
+    std::vector<WindowStats> stats;
+
+    ModelRun(const ClfConfig& config, Metric m)
+        : clf(config), metric(std::move(m)) {}
+};
+
+/**
+ * Like `stream_emails`, but for several classifiers side by side on the same
+ * stream. Each email is tokenized once and its n-grams are hashed once for the
+ * union of the seeds that the models need (see `HashSpec`); every model then
+ * masks the shared hashes to its own number of buckets. The models see exactly
+ * the same buckets as when they run on their own.
+ *
+ * The `seconds` of each model's `WindowStats` only include that model's
+ * predictions, metric and updates. The time spent hashing is returned.
+ */
+template <typename Metric>
+double stream_emails_shared(const std::vector<Email>& emails,
+                            std::vector<ModelRun<Metric>>& runs, int window) {
+    using clock = std::chrono::steady_clock;
+
+    HashSpec spec;
+    for (const ModelRun<Metric>& run : runs)
+        run.clf.require_hashes(spec);
+
+    double hash_seconds = 0.0;
+    std::vector<HashedEmail> hashed(window); // reused across windows
+    for (size_t i = 0; i < emails.size(); i+=window) {
+        size_t n = std::min(static_cast<size_t>(window), emails.size() - i);
+
+        clock::time_point begin = clock::now();
+        for (size_t u = 0; u < n; ++u)
+            hashed[u].assign<AnyClf::Hasher>(emails[i+u], spec);
+        hash_seconds += std::chrono::duration<double>(clock::now() - begin).count();
+
+        for (ModelRun<Metric>& run : runs) {
+            WindowStats ws;
+            PhaseStats phases_begin = phase_stats();
+            begin = clock::now();
+
+            for (size_t u = 0; u < n; ++u) {
+                BDAP_PROFILE_SCOPE(Phase::Metric, 0);
+                double pr = run.clf.predict(hashed[u]);
+                run.metric.observe(hashed[u].is_spam(), pr, run.clf.classify(pr));
+            }
+
+            run.metric_values.push_back(run.metric.get_score());
+            if constexpr (has_scores<Metric>::value)
+                ws.scores = run.metric.get_scores();
+
+            for (size_t u = 0; u < n; ++u)
+                run.clf.update(hashed[u]);
+
+            ws.seconds = std::chrono::duration<double>(clock::now() - begin).count();
+            ws.phases = phase_stats();
+            ws.phases -= phases_begin;
+            ws.num_emails = n;
+            for (size_t u = 0; u < n; ++u)
+                ws.num_ngrams += hashed[u].num_ngrams(run.clf.ngram());
+            run.stats.push_back(ws);
+        }
+    }
+    return hash_seconds;
+}
+
+} // namespace bdap
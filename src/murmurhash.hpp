@@ -1,3 +1,5 @@
+#pragma once
+
 // source: https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
 
 #include <stdlib.h>
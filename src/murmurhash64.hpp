@@ -0,0 +1,57 @@
+#pragma once
+
+// source: https://github.com/aappleby/smhasher/blob/master/src/MurmurHash2.cpp
+// MurmurHash2, 64-bit versions, by Austin Appleby (public domain)
+
+#include <cstdint>
+#include <cstring>
+
+namespace bdap {
+
+//-----------------------------------------------------------------------------
+// MurmurHash64A, 64-bit hash for 64-bit platforms. Unaligned reads use memcpy.
+
+inline uint64_t MurmurHash64A ( const void * key, int len, uint64_t seed )
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+
+  uint64_t h = seed ^ (len * m);
+
+  const unsigned char * data = (const unsigned char *)key;
+  const unsigned char * end = data + (len/8)*8;
+
+  while(data != end)
+  {
+    uint64_t k;
+    std::memcpy(&k, data, sizeof(k));
+    data += 8;
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  switch(len & 7)
+  {
+  case 7: h ^= uint64_t(data[6]) << 48; [[fallthrough]];
+  case 6: h ^= uint64_t(data[5]) << 40; [[fallthrough]];
+  case 5: h ^= uint64_t(data[4]) << 32; [[fallthrough]];
+  case 4: h ^= uint64_t(data[3]) << 24; [[fallthrough]];
+  case 3: h ^= uint64_t(data[2]) << 16; [[fallthrough]];
+  case 2: h ^= uint64_t(data[1]) << 8; [[fallthrough]];
+  case 1: h ^= uint64_t(data[0]);
+          h *= m;
+  };
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+
+  return h;
+}
+
+} // namespace bdap
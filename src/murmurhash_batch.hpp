@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "murmurhash.hpp"
+
+/**
+ * MurmurHash3_x64_128 of many keys at once, one key per SIMD lane.
+ *
+ * The n-grams are short (a handful of 16-byte blocks at most), so hashing one
+ * at a time is a chain of dependent 64-bit multiplies with little to overlap
+ * it with. Here 8 (AVX-512) or 4 (AVX2) keys go through the rounds side by
+ * side. Each lane gathers its own blocks and tail, so the keys can have any
+ * lengths: lanes whose key has fewer blocks are masked out of the later
+ * rounds, and a tail is read as the 16 bytes that end it (or, for keys shorter
+ * than 16 bytes, as overlapping 8- or 4-byte words) and shifted into place,
+ * never reading outside the key. Keys of 1 to 3 bytes are read byte by byte.
+ * The result is bit-identical to `MurmurHash3_x64_128`.
+ *
+ * The kernels are compiled for AVX-512 and AVX2 with target attributes and the
+ * instruction set is picked at run time, so the build does not need
+ * `-march`. Other compilers and CPUs, and BDAP_SIMD_HASH=0, use the scalar
+ * function.
+ */
+#ifndef BDAP_SIMD_HASH
+#define BDAP_SIMD_HASH 1
+#endif
+
+#if BDAP_SIMD_HASH && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BDAP_SIMD_HASH_X86 1
+#include <immintrin.h>
+#else
+#define BDAP_SIMD_HASH_X86 0
+#endif
+
+namespace bdap {
+namespace murmur3_batch_detail {
+
+constexpr uint64_t C1 = 0x87c37b91114253d5ULL;
+constexpr uint64_t C2 = 0x4cf5ad432745937fULL;
+constexpr uint64_t FMIX1 = 0xff51afd7ed558ccdULL;
+constexpr uint64_t FMIX2 = 0xc4ceb9fe1a85ec53ULL;
+
+/** The two halves of the output xor-ed together, as `Murmur3Hash`. */
+inline uint64_t fold(const std::string_view& key, uint32_t seed) {
+    uint64_t out[2] = {0};
+    MurmurHash3_x64_128(key.data(), static_cast<int>(key.size()), seed, &out);
+    return out[0] ^ out[1];
+}
+
+/** The tail of a key of 1 to 3 bytes, as the scalar code reads it. */
+inline uint64_t tiny_tail(const std::string_view& key) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(key.data());
+    size_t n = key.size();
+    return uint64_t(p[0]) | (uint64_t(p[n >> 1]) << (8 * (n >> 1)))
+         | (uint64_t(p[n - 1]) << (8 * (n - 1)));
+}
+
+/** Largest number of 16-byte blocks of the `n` keys. */
+inline size_t max_blocks(const std::string_view *keys, size_t n) {
+    size_t m = 0;
+    for (size_t j = 0; j < n; ++j)
+        m = std::max(m, keys[j].size() / 16);
+    return m;
+}
+
+#if BDAP_SIMD_HASH_X86
+
+#define BDAP_AVX512 __attribute__((target("avx512f,avx512dq")))
+#define BDAP_AVX2 __attribute__((target("avx2")))
+
+namespace avx512 {
+
+BDAP_AVX512 inline __m512i set1(uint64_t x) { return _mm512_set1_epi64(static_cast<long long>(x)); }
+BDAP_AVX512 inline __m512i mul(__m512i a, uint64_t c) { return _mm512_mullo_epi64(a, set1(c)); }
+BDAP_AVX512 inline __m512i mul5(__m512i a) { return _mm512_add_epi64(_mm512_slli_epi64(a, 2), a); }
+
+BDAP_AVX512 inline __m512i fmix(__m512i k) {
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = mul(k, FMIX1);
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = mul(k, FMIX2);
+    return _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+}
+
+BDAP_AVX512 inline __m512i gather(__mmask8 m, __m512i addr)
+{ return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), m, addr, nullptr, 1); }
+
+/** Hash `keys[0..8)` into `out[0..8)`. */
+BDAP_AVX512 inline void hash8(const std::string_view *k, uint32_t seed, uint64_t *out) {
+    auto addr = [k](int j) { return reinterpret_cast<long long>(k[j].data()); };
+    auto size = [k](int j) { return static_cast<long long>(k[j].size()); };
+    const __m512i len = _mm512_set_epi64(size(7), size(6), size(5), size(4),
+                                         size(3), size(2), size(1), size(0));
+    const __m512i ptr = _mm512_set_epi64(addr(7), addr(6), addr(5), addr(4),
+                                         addr(3), addr(2), addr(1), addr(0));
+    const __m512i nblocks = _mm512_srli_epi64(len, 4);
+    __m512i h1 = set1(seed);
+    __m512i h2 = h1;
+
+    //----------
+    // body
+
+    size_t num_rounds = max_blocks(k, 8);
+    for (size_t i = 0; i < num_rounds; ++i) {
+        __mmask8 active = _mm512_cmpgt_epu64_mask(nblocks, set1(i));
+        __m512i block = _mm512_add_epi64(ptr, set1(16 * i));
+        __m512i k1 = gather(active, block);
+        __m512i k2 = gather(active, _mm512_add_epi64(block, set1(8)));
+
+        k1 = mul(k1, C1); k1 = _mm512_rol_epi64(k1, 31); k1 = mul(k1, C2);
+        __m512i n1 = _mm512_xor_si512(h1, k1);
+        n1 = _mm512_rol_epi64(n1, 27); n1 = _mm512_add_epi64(n1, h2);
+        n1 = _mm512_add_epi64(mul5(n1), set1(0x52dce729));
+
+        k2 = mul(k2, C2); k2 = _mm512_rol_epi64(k2, 33); k2 = mul(k2, C1);
+        __m512i n2 = _mm512_xor_si512(h2, k2);
+        n2 = _mm512_rol_epi64(n2, 31); n2 = _mm512_add_epi64(n2, n1);
+        n2 = _mm512_add_epi64(mul5(n2), set1(0x38495ab5));
+
+        h1 = _mm512_mask_mov_epi64(h1, active, n1);
+        h2 = _mm512_mask_mov_epi64(h2, active, n2);
+    }
+
+    //----------
+    // tail
+
+    const __m512i rem = _mm512_and_si512(len, set1(15));
+    const __m512i end = _mm512_add_epi64(ptr, len);
+    const __mmask8 has_tail = _mm512_test_epi64_mask(rem, rem);
+    const __mmask8 ge16 = _mm512_cmpge_epu64_mask(len, set1(16)) & has_tail;
+    const __mmask8 ge8 = _mm512_cmpge_epu64_mask(len, set1(8)) & has_tail;
+    const __mmask8 mid = ge8 & ~ge16;
+    const __mmask8 ge4_lt8 = _mm512_cmpge_epu64_mask(len, set1(4))
+                           & _mm512_cmplt_epu64_mask(len, set1(8));
+
+    // The 16 bytes that end the key (16 bytes or longer) or its first and
+    // last 8 bytes (8 to 15 bytes long), shifted so that the tail starts at
+    // bit 0 of t1.
+    __m512i t1 = _mm512_setzero_si512();
+    __m512i t2 = _mm512_setzero_si512();
+    if (ge8) {
+        __m512i lo = gather(ge8, _mm512_mask_mov_epi64(
+                _mm512_sub_epi64(end, set1(16)), mid, ptr));
+        __m512i hi = gather(ge8, _mm512_sub_epi64(end, set1(8)));
+        __m512i s = _mm512_slli_epi64(_mm512_sub_epi64(set1(16), rem), 3);
+        // shifts by 64 bits or more give 0, so this is a 128-bit shift
+        __m512i shifted = _mm512_or_si512(
+                _mm512_or_si512(_mm512_srlv_epi64(lo, s),
+                                _mm512_sllv_epi64(hi, _mm512_sub_epi64(set1(64), s))),
+                _mm512_srlv_epi64(hi, _mm512_sub_epi64(s, set1(64))));
+        t1 = _mm512_mask_mov_epi64(shifted, mid, lo);
+        t2 = _mm512_srlv_epi64(hi, s);
+    }
+    // 4 to 7 bytes: the first and the last 4 bytes
+    if (ge4_lt8) {
+        __m256i a = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), ge4_lt8,
+                                                ptr, nullptr, 1);
+        __m256i b = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), ge4_lt8,
+                                                _mm512_sub_epi64(end, set1(4)),
+                                                nullptr, 1);
+        __m512i s = _mm512_slli_epi64(_mm512_sub_epi64(len, set1(4)), 3);
+        t1 = _mm512_mask_mov_epi64(t1, ge4_lt8, _mm512_or_si512(
+                _mm512_cvtepu32_epi64(a),
+                _mm512_sllv_epi64(_mm512_cvtepu32_epi64(b), s)));
+    }
+    // 1 to 3 bytes
+    unsigned tiny = has_tail & ~_mm512_cmpge_epu64_mask(len, set1(4));
+    for (; tiny; tiny &= tiny - 1) {
+        int j = __builtin_ctz(tiny);
+        t1 = _mm512_mask_set1_epi64(t1, __mmask8(1u << j),
+                                    static_cast<long long>(tiny_tail(k[j])));
+    }
+
+    __mmask8 gt8 = _mm512_cmpgt_epu64_mask(rem, set1(8));
+    t2 = mul(t2, C2); t2 = _mm512_rol_epi64(t2, 33); t2 = mul(t2, C1);
+    h2 = _mm512_mask_xor_epi64(h2, gt8, h2, t2);
+    t1 = mul(t1, C1); t1 = _mm512_rol_epi64(t1, 31); t1 = mul(t1, C2);
+    h1 = _mm512_mask_xor_epi64(h1, has_tail, h1, t1);
+
+    //----------
+    // finalization
+
+    h1 = _mm512_xor_si512(h1, len); h2 = _mm512_xor_si512(h2, len);
+    h1 = _mm512_add_epi64(h1, h2);
+    h2 = _mm512_add_epi64(h2, h1);
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 = _mm512_add_epi64(h1, h2);
+    h2 = _mm512_add_epi64(h2, h1);
+
+    _mm512_storeu_si512(out, _mm512_xor_si512(h1, h2));
+}
+
+} // namespace avx512
+
+namespace avx2 {
+
+BDAP_AVX2 inline __m256i set1(uint64_t x) { return _mm256_set1_epi64x(static_cast<long long>(x)); }
+
+/** 64-bit multiply by a constant, from 32-bit multiplies. */
+BDAP_AVX2 inline __m256i mul(__m256i a, uint64_t c) {
+    __m256i lo = _mm256_mul_epu32(a, set1(c));
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), set1(c)),
+                                     _mm256_mul_epu32(a, set1(c >> 32)));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+BDAP_AVX2 inline __m256i mul5(__m256i a) { return _mm256_add_epi64(_mm256_slli_epi64(a, 2), a); }
+
+template <int R>
+BDAP_AVX2 inline __m256i rotl(__m256i x)
+{ return _mm256_or_si256(_mm256_slli_epi64(x, R), _mm256_srli_epi64(x, 64 - R)); }
+
+BDAP_AVX2 inline __m256i fmix(__m256i k) {
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul(k, FMIX1);
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul(k, FMIX2);
+    return _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+}
+
+BDAP_AVX2 inline __m256i gather(__m256i m, __m256i addr) {
+    return _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), nullptr, addr, m, 1);
+}
+
+/** `m ? b : a`, per lane, with `m` all ones or all zeros. */
+BDAP_AVX2 inline __m256i select(__m256i m, __m256i b, __m256i a)
+{ return _mm256_blendv_epi8(a, b, m); }
+
+/** `a > b`; lengths and block counts are far below 2^63. */
+BDAP_AVX2 inline __m256i gt(__m256i a, __m256i b) { return _mm256_cmpgt_epi64(a, b); }
+
+BDAP_AVX2 inline int bits(__m256i m) { return _mm256_movemask_pd(_mm256_castsi256_pd(m)); }
+
+/** Hash `keys[0..4)` into `out[0..4)`, as `avx512::hash8`. */
+BDAP_AVX2 inline void hash4(const std::string_view *k, uint32_t seed, uint64_t *out) {
+    auto addr = [k](int j) { return reinterpret_cast<long long>(k[j].data()); };
+    auto size = [k](int j) { return static_cast<long long>(k[j].size()); };
+    const __m256i len = _mm256_set_epi64x(size(3), size(2), size(1), size(0));
+    const __m256i ptr = _mm256_set_epi64x(addr(3), addr(2), addr(1), addr(0));
+    const __m256i nblocks = _mm256_srli_epi64(len, 4);
+    __m256i h1 = set1(seed);
+    __m256i h2 = h1;
+
+    //----------
+    // body
+
+    size_t num_rounds = max_blocks(k, 4);
+    for (size_t i = 0; i < num_rounds; ++i) {
+        __m256i active = gt(nblocks, set1(i));
+        __m256i block = _mm256_add_epi64(ptr, set1(16 * i));
+        __m256i k1 = gather(active, block);
+        __m256i k2 = gather(active, _mm256_add_epi64(block, set1(8)));
+
+        k1 = mul(k1, C1); k1 = rotl<31>(k1); k1 = mul(k1, C2);
+        __m256i n1 = _mm256_xor_si256(h1, k1);
+        n1 = rotl<27>(n1); n1 = _mm256_add_epi64(n1, h2);
+        n1 = _mm256_add_epi64(mul5(n1), set1(0x52dce729));
+
+        k2 = mul(k2, C2); k2 = rotl<33>(k2); k2 = mul(k2, C1);
+        __m256i n2 = _mm256_xor_si256(h2, k2);
+        n2 = rotl<31>(n2); n2 = _mm256_add_epi64(n2, n1);
+        n2 = _mm256_add_epi64(mul5(n2), set1(0x38495ab5));
+
+        h1 = select(active, n1, h1);
+        h2 = select(active, n2, h2);
+    }
+
+    //----------
+    // tail
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rem = _mm256_and_si256(len, set1(15));
+    const __m256i end = _mm256_add_epi64(ptr, len);
+    const __m256i has_tail = gt(rem, zero);
+    const __m256i ge16 = _mm256_and_si256(gt(len, set1(15)), has_tail);
+    const __m256i ge8 = _mm256_and_si256(gt(len, set1(7)), has_tail);
+    const __m256i mid = _mm256_andnot_si256(ge16, ge8);
+    const __m256i ge4_lt8 = _mm256_andnot_si256(gt(len, set1(7)), gt(len, set1(3)));
+
+    __m256i t1 = zero;
+    __m256i t2 = zero;
+    if (bits(ge8)) {
+        __m256i lo = gather(ge8, select(mid, ptr, _mm256_sub_epi64(end, set1(16))));
+        __m256i hi = gather(ge8, _mm256_sub_epi64(end, set1(8)));
+        __m256i s = _mm256_slli_epi64(_mm256_sub_epi64(set1(16), rem), 3);
+        __m256i shifted = _mm256_or_si256(
+                _mm256_or_si256(_mm256_srlv_epi64(lo, s),
+                                _mm256_sllv_epi64(hi, _mm256_sub_epi64(set1(64), s))),
+                _mm256_srlv_epi64(hi, _mm256_sub_epi64(s, set1(64))));
+        t1 = select(mid, lo, shifted);
+        t2 = _mm256_srlv_epi64(hi, s);
+    }
+    if (bits(ge4_lt8)) {
+        // the 64-bit lane mask narrowed to the 32-bit lanes of the gather
+        __m128i m = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+                ge4_lt8, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+        __m128i a = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), nullptr,
+                                                ptr, m, 1);
+        __m128i b = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), nullptr,
+                                                _mm256_sub_epi64(end, set1(4)), m, 1);
+        __m256i s = _mm256_slli_epi64(_mm256_sub_epi64(len, set1(4)), 3);
+        t1 = select(ge4_lt8, _mm256_or_si256(
+                _mm256_cvtepu32_epi64(a),
+                _mm256_sllv_epi64(_mm256_cvtepu32_epi64(b), s)), t1);
+    }
+    int tiny = bits(_mm256_andnot_si256(gt(len, set1(3)), has_tail));
+    for (; tiny; tiny &= tiny - 1) {
+        int j = __builtin_ctz(tiny);
+        __m256i lane = _mm256_cmpeq_epi64(_mm256_setr_epi64x(0, 1, 2, 3), set1(j));
+        t1 = select(lane, set1(tiny_tail(k[j])), t1);
+    }
+
+    __m256i gt8 = gt(rem, set1(8));
+    t2 = mul(t2, C2); t2 = rotl<33>(t2); t2 = mul(t2, C1);
+    h2 = _mm256_xor_si256(h2, _mm256_and_si256(t2, gt8));
+    t1 = mul(t1, C1); t1 = rotl<31>(t1); t1 = mul(t1, C2);
+    h1 = _mm256_xor_si256(h1, _mm256_and_si256(t1, has_tail));
+
+    //----------
+    // finalization
+
+    h1 = _mm256_xor_si256(h1, len); h2 = _mm256_xor_si256(h2, len);
+    h1 = _mm256_add_epi64(h1, h2);
+    h2 = _mm256_add_epi64(h2, h1);
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 = _mm256_add_epi64(h1, h2);
+    h2 = _mm256_add_epi64(h2, h1);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_xor_si256(h1, h2));
+}
+
+} // namespace avx2
+
+#undef BDAP_AVX512
+#undef BDAP_AVX2
+
+/** Hash `keys[0..n)` with `kernel`, `L` keys at a time, the last batch padded
+ * with empty keys. */
+template <size_t L, typename Kernel>
+inline void hash_lanes(Kernel kernel, const std::string_view *keys, size_t n,
+                       uint32_t seed, uint64_t *out) {
+    size_t i = 0;
+    for (; i + L <= n; i += L)
+        kernel(keys + i, seed, out + i);
+    if (i < n) {
+        std::string_view padded[L];
+        uint64_t padded_out[L];
+        std::copy(keys + i, keys + n, padded);
+        kernel(padded, seed, padded_out);
+        std::copy(padded_out, padded_out + (n - i), out + i);
+    }
+}
+
+enum class SimdLevel { Scalar, Avx2, Avx512 };
+
+inline SimdLevel detect_simd_level() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::Avx2;
+    return SimdLevel::Scalar;
+}
+
+inline SimdLevel simd_level() {
+    static const SimdLevel level = detect_simd_level();
+    return level;
+}
+
+#endif // BDAP_SIMD_HASH_X86
+
+} // namespace murmur3_batch_detail
+
+/**
+ * `out[i] = h[0] ^ h[1]` with `h` the `MurmurHash3_x64_128` of `keys[i]`, for
+ * `i` in `[0, n)`.
+ */
+inline void MurmurHash3_x64_128_batch(const std::string_view *keys, size_t n,
+                                      uint32_t seed, uint64_t *out) {
+    using namespace murmur3_batch_detail;
+#if BDAP_SIMD_HASH_X86
+    switch (simd_level()) {
+    case SimdLevel::Avx512:
+        hash_lanes<8>(avx512::hash8, keys, n, seed, out);
+        return;
+    case SimdLevel::Avx2:
+        hash_lanes<4>(avx2::hash4, keys, n, seed, out);
+        return;
+    case SimdLevel::Scalar:
+        break;
+    }
+#endif
+    for (size_t i = 0; i < n; ++i)
+        out[i] = fold(keys[i], seed);
+}
+
+/**
+ * Compare the SIMD kernels that this CPU supports, and the dispatching
+ * function, with the scalar `MurmurHash3_x64_128` on every key length up to
+ * 64 bytes, at several alignments, in batches that mix long and short keys
+ * and end with a partial batch, for a few seeds. Stored models depend on the
+ * hashes, so a kernel must never differ. Returns the name of the first one
+ * that does, or nullptr.
+ */
+inline const char *MurmurHash3_x64_128_batch_check() {
+    using namespace murmur3_batch_detail;
+    char buf[96];
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        buf[i] = static_cast<char>(i * 167 + 13);
+    const size_t n = 65;
+    std::string_view keys[2 * n];
+    for (size_t len = 0; len < n; ++len) {
+        keys[len] = std::string_view(buf + len % 8, len);
+        size_t mixed = len * 37 % n;
+        keys[n + len] = std::string_view(buf + len % 13, mixed);
+    }
+    uint64_t out[2 * n];
+    for (uint32_t seed : {0u, 1u, 0xa738ccu, 0xffffffffu}) {
+        auto differs = [&]() {
+            for (size_t i = 0; i < 2 * n; ++i)
+                if (out[i] != fold(keys[i], seed))
+                    return true;
+            return false;
+        };
+#if BDAP_SIMD_HASH_X86
+        if (simd_level() == SimdLevel::Avx512) {
+            hash_lanes<8>(avx512::hash8, keys, 2 * n, seed, out);
+            if (differs())
+                return "avx512";
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            hash_lanes<4>(avx2::hash4, keys, 2 * n, seed, out);
+            if (differs())
+                return "avx2";
+        }
+#endif
+        MurmurHash3_x64_128_batch(keys, 2 * n, seed, out);
+        if (differs())
+            return "MurmurHash3_x64_128_batch";
+    }
+    return nullptr;
+}
+
+} // namespace bdap
@@ -1,12 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <stdexcept>
 #include <string_view>
 #include <vector>
 #include "email.hpp"
+#include "anytime.hpp"
 #include "base_classifier.hpp"
+#include "snapshot.hpp"
+#include "decayed_counts.hpp"
+#include "heavy_hitters.hpp"
+#include "hot_table.hpp"
 
 namespace bdap {
 
@@ -19,6 +26,22 @@ class NaiveBayesCountMin : public BaseClf<NaiveBayesCountMin> {
     int nSpamGrams_;
     int nHamGrams_;
     std::vector<std::vector<int>> counts_;
+    HeavyHitters top_spam_; // disabled unless `track_heavy_hitters`
+    HeavyHitters top_ham_;
+
+    struct HotCounts { int spam, ham; };
+    HotTable<HotCounts> hot_; // disabled unless `use_hot_table`
+    int promote_at_ = 0;
+
+    // Only with `use_decay`: decayed counts instead of `counts_`, and the
+    // decayed totals (excluding the initial 1 of every count).
+    std::vector<DecayedCounts> decayed_;
+    double dSpam_ = 0.0, dHam_ = 0.0, dSpamGrams_ = 0.0, dHamGrams_ = 0.0;
+
+    // Only with `use_anytime_predict`: the largest ham and spam count of the
+    // first row, which bounds every count-min estimate (and hot count).
+    AnytimePredict anytime_;
+    int maxCounts_[2] = {1, 1};
 
 public:
     NaiveBayesCountMin(int ngram, int num_hashes, int log_num_buckets)
@@ -34,62 +57,286 @@ public:
         counts_.resize(num_hashes, std::vector<int>((1 << log_num_buckets_) * 2, 1));
     }
 
-    void update_(const Email &email) {
+    int ngram() const { return ngram_; }
+
+    void require_hashes(HashSpec& spec) const { spec.require_seq(ngram_, num_hashes_); }
+
+    template <typename E> // Email or HashedEmail
+    void update_(const E& email) {
+        if (!decayed_.empty())
+            return update_decayed(email);
         int isSpam = email.is_spam();
-        EmailIter allngrams(email, ngram_);
-        std::string_view ngram;
-        if (isSpam) {
-            ++nSpam_;
-            while (allngrams)
-            {
-                ngram = allngrams.next();
-                for (int i = 0; i < num_hashes_; i++) {
-                    ++counts_[i][get_bucket(ngram, isSpam, i)];
-                }
-                ++nSpamGrams_;
+        auto allngrams = ngrams_of(email, ngram_);
+        HeavyHitters& top = isSpam ? top_spam_ : top_ham_;
+        int& nGrams = isSpam ? nSpamGrams_ : nHamGrams_;
+        ++(isSpam ? nSpam_ : nHam_);
+        while (allngrams)
+        {
+            allngrams.next();
+            size_t h = allngrams.hash(0);
+            size_t fingerprint = h;
+            int estimate = ++counts_[0][get_bucket(h, isSpam)];
+            if (anytime_.enabled)
+                maxCounts_[isSpam] = std::max(maxCounts_[isSpam], estimate);
+            for (int i = 1; i < num_hashes_; i++) {
+                h = allngrams.hash(i);
+                estimate = std::min(estimate, ++counts_[i][get_bucket(h, isSpam)]);
             }
-        }
-        else {
-            ++nHam_;
-            while (allngrams)
-            {
-                ngram = allngrams.next();
-                for (int i = 0; i < num_hashes_; i++) {
-                    ++counts_[i][get_bucket(ngram, isSpam, i)];
+            if (top.enabled())
+                top.offer(fingerprint, ngram_text(allngrams), estimate);
+            if (hot_.enabled()) {
+                if (HotCounts *hot = hot_.touch(fingerprint)) {
+                    ++(isSpam ? hot->spam : hot->ham);
+                } else if (estimate >= promote_at_ && (hot_.size() < hot_.capacity()
+                            || (estimate & 15) == 0)) { // limit churn when full
+                    HotCounts c;
+                    count(allngrams, fingerprint, c.spam, c.ham);
+                    hot_.insert(fingerprint, c);
                 }
-                ++nHamGrams_;
             }
+            ++nGrams;
         }
     }
 
-    double predict_(const Email& email) const {
+    template <typename E>
+    double predict_(const E& email) const {
+        if (!decayed_.empty())
+            return predict_decayed(email);
+        if (anytime_.enabled)
+            return predict_anytime(email);
         double result = std::log((double)nSpam_ / (double)nHam_);
-        EmailIter allngrams(email, ngram_);
-        std::string_view ngram;
+        auto allngrams = ngrams_of(email, ngram_);
         while (allngrams)
         {
-            ngram = allngrams.next();
-            result += std::log(((double)count(ngram, 1) / (double)nSpamGrams_) / ((double)count(ngram, 0) / (double)nHamGrams_));
+            allngrams.next();
+            result += log_ratio(allngrams);
         }
         result = std::exp(result);
         return result / (1 + result);
     }
 
+    /**
+     * Track the `capacity` most frequent spam and ham n-grams from now on,
+     * ranked by their count-min estimates (see `HeavyHitters`). Memory is
+     * fixed: `2 * capacity` items plus the n-gram texts. N-grams of a
+     * `HashedEmail` are tracked by hash only, their text is empty.
+     */
+    void track_heavy_hitters(size_t capacity) {
+        if (!decayed_.empty())
+            throw std::logic_error("heavy hitters are not tracked with decay");
+        top_spam_ = HeavyHitters(capacity);
+        top_ham_ = HeavyHitters(capacity);
+    }
+
+    /** The `n` most frequent spam n-grams, most frequent first, with their
+     * count-min estimates as of their last occurrence. */
+    std::vector<HeavyHitters::Item> top_spam_ngrams(size_t n) const
+    { return top_spam_.top(n); }
+
+    /** The `n` most frequent ham n-grams, see `top_spam_ngrams`. */
+    std::vector<HeavyHitters::Item> top_ham_ngrams(size_t n) const
+    { return top_ham_.top(n); }
+
+    /**
+     * Keep exact counts for up to `capacity` hot n-grams from now on. An
+     * n-gram is promoted once its count-min estimate in a class reaches
+     * `promote_at` (once full, checked every 16th occurrence, replacing an
+     * n-gram that was not used recently), starting from its estimates at
+     * that time. Predictions
+     * for hot n-grams then take one hash and one probe into a small table
+     * instead of `num_hashes` probes into the sketch.
+     *
+     * The sketch is still updated for all n-grams, and it is all that `save`
+     * writes, so a `MappedModel` of the snapshot only approximates this
+     * model's predictions.
+     */
+    void use_hot_table(size_t capacity, int promote_at = 64) {
+        if (!decayed_.empty())
+            throw std::logic_error("no hot table with decay");
+        hot_ = HotTable<HotCounts>(capacity);
+        promote_at_ = promote_at;
+    }
+
+    /**
+     * Stop predictions early from now on (see `AnytimePredict`): once the
+     * remaining n-grams cannot change the classification, or after
+     * `max_ngrams` n-grams (0 for no limit). The bounds come from the largest
+     * spam and ham count of the first row, which `update` then keeps track
+     * of. Not combined with `use_decay`.
+     */
+    void use_anytime_predict(size_t max_ngrams = 0) {
+        if (!decayed_.empty())
+            throw std::logic_error("no anytime prediction with decay");
+        anytime_.enabled = true;
+        anytime_.max_ngrams = max_ngrams;
+        for (size_t i = 0; i < counts_[0].size(); ++i)
+            maxCounts_[i % 2] = std::max(maxCounts_[i % 2], counts_[0][i]);
+    }
+
+    /**
+     * Let all counts, and the email and n-gram totals, decay exponentially
+     * from now on: they lose half of their weight every `half_life` emails.
+     * Buckets are rescaled lazily when they are next touched (see
+     * `DecayedCounts`), at a granularity of `epoch_length` emails (default
+     * `half_life / 16`). The counts gathered so far are carried over.
+     *
+     * Not combined with `track_heavy_hitters` or `use_hot_table`, whose
+     * counts only grow, or with `use_anytime_predict`. Calling it again with
+     * decay already on only changes the half-life and epoch length.
+     */
+    void use_decay(double half_life, uint32_t epoch_length = 0) {
+        if (top_spam_.enabled() || hot_.enabled())
+            throw std::logic_error("no decay with heavy hitters or a hot table");
+        if (anytime_.enabled)
+            throw std::logic_error("no decay with anytime prediction");
+        if (epoch_length == 0)
+            epoch_length = static_cast<uint32_t>(std::max(1.0, half_life / 16));
+        if (!decayed_.empty()) {
+            for (auto& row : decayed_)
+                row.retune(half_life, epoch_length, num_examples_processed);
+            return;
+        }
+        for (const auto& row : counts_) {
+            decayed_.emplace_back(row.size(), half_life, epoch_length);
+            decayed_.back().advance(num_examples_processed);
+            for (size_t i = 0; i < row.size(); ++i)
+                decayed_.back().add(i, row[i] - 1);
+        }
+        dSpam_ = nSpam_ - 1;
+        dHam_ = nHam_ - 1;
+        dSpamGrams_ = nSpamGrams_ - 1;
+        dHamGrams_ = nHamGrams_ - 1;
+        counts_.assign(num_hashes_, std::vector<int>());
+    }
+
+    /** Size of the count tables (and heavy hitter trackers and hot table) in
+     * bytes. */
+    size_t memory_bytes() const {
+        size_t bytes = counts_.capacity() * sizeof(std::vector<int>)
+            + top_spam_.memory_bytes() + top_ham_.memory_bytes()
+            + hot_.memory_bytes();
+        for (const auto& row : decayed_)
+            bytes += row.memory_bytes();
+        for (const auto& row : counts_)
+            bytes += row.capacity() * sizeof(int);
+        return bytes;
+    }
+
+    /** Write the model as a snapshot that `MappedModel` can map. */
+    void save(std::ostream& os) const {
+        if (!decayed_.empty())
+            throw std::logic_error("cannot save a model with decayed counts");
+        SnapshotHeader header = make_snapshot_header(
+                ModelKind::NaiveBayesCountMin, hash_kind, ngram_, num_hashes_,
+                log_num_buckets_, 0, threshold());
+        header.n_spam = nSpam_;
+        header.n_ham = nHam_;
+        header.n_spam_grams = nSpamGrams_;
+        header.n_ham_grams = nHamGrams_;
+        std::vector<const std::vector<int> *> rows;
+        for (const auto& row : counts_)
+            rows.push_back(&row);
+        write_snapshot(os, header, rows);
+    }
+
+    /** Read a model written by `save`, to continue training it. The header
+     * was already read with `read_snapshot_header`. */
+    static NaiveBayesCountMin load(const SnapshotHeader& header,
+                                   std::istream& is) {
+        NaiveBayesCountMin clf{header.ngram, header.num_hashes,
+                               header.log_num_buckets};
+        std::vector<std::vector<int> *> rows;
+        for (auto& row : clf.counts_)
+            rows.push_back(&row);
+        read_snapshot(is, header, ModelKind::NaiveBayesCountMin, hash_kind, rows);
+        clf.nSpam_ = static_cast<int>(header.n_spam);
+        clf.nHam_ = static_cast<int>(header.n_ham);
+        clf.nSpamGrams_ = static_cast<int>(header.n_spam_grams);
+        clf.nHamGrams_ = static_cast<int>(header.n_ham_grams);
+        clf.num_examples_processed = clf.nSpam_ + clf.nHam_ - 2;
+        return clf;
+    }
+
 private:
-    int count(std::string_view ngram, int is_spam) const {
-        int test;
-        int min = counts_[0][get_bucket(ngram, is_spam, 0)];
-        for (int i = 1; i < num_hashes_; i++) {
-            test = counts_[i][get_bucket(ngram, is_spam, i)];
-            if (test < min) {
-                min = test;
+    /** The log likelihood ratio of the current n-gram of `ngrams`. */
+    template <typename Ngrams>
+    double log_ratio(const Ngrams& ngrams) const {
+        int spam, ham;
+        size_t h = ngrams.hash(0);
+        const HotCounts *hot = hot_.enabled() ? hot_.find(h) : nullptr;
+        if (hot) {
+            spam = hot->spam;
+            ham = hot->ham;
+        } else {
+            count(ngrams, h, spam, ham);
+        }
+        return std::log(((double)spam / (double)nSpamGrams_) / ((double)ham / (double)nHamGrams_));
+    }
+
+    template <typename E>
+    double predict_anytime(const E& email) const {
+        // every count is in [1, maxCounts_], see `log_ratio`
+        double k = std::log((double)nHamGrams_ / (double)nSpamGrams_);
+        double result = anytime_sum(ngrams_of(email, ngram_),
+                std::log((double)nSpam_ / (double)nHam_), 0.0,
+                k - std::log((double)maxCounts_[0]), k + std::log((double)maxCounts_[1]),
+                anytime_, [this](const auto& ngrams) { return log_ratio(ngrams); });
+        result = std::exp(result);
+        return result / (1 + result);
+    }
+
+    template <typename E>
+    void update_decayed(const E& email) {
+        double f = 1.0;
+        for (DecayedCounts& row : decayed_)
+            f = row.advance(num_examples_processed);
+        dSpam_ *= f; dHam_ *= f; dSpamGrams_ *= f; dHamGrams_ *= f;
+
+        int isSpam = email.is_spam();
+        double& grams = isSpam ? dSpamGrams_ : dHamGrams_;
+        ++(isSpam ? dSpam_ : dHam_);
+        auto allngrams = ngrams_of(email, ngram_);
+        while (allngrams) {
+            allngrams.next();
+            for (int i = 0; i < num_hashes_; i++)
+                decayed_[i].add(get_bucket(allngrams.hash(i), isSpam));
+            ++grams;
+        }
+    }
+
+    template <typename E>
+    double predict_decayed(const E& email) const {
+        double result = std::log((1 + dSpam_) / (1 + dHam_));
+        auto allngrams = ngrams_of(email, ngram_);
+        while (allngrams) {
+            allngrams.next();
+            size_t h = allngrams.hash(0);
+            double spam = decayed_[0].get(get_bucket(h, 1));
+            double ham = decayed_[0].get(get_bucket(h, 0));
+            for (int i = 1; i < num_hashes_; i++) {
+                h = allngrams.hash(i);
+                spam = std::min(spam, decayed_[i].get(get_bucket(h, 1)));
+                ham = std::min(ham, decayed_[i].get(get_bucket(h, 0)));
             }
+            result += std::log(((1 + spam) / (1 + dSpamGrams_))
+                / ((1 + ham) / (1 + dHamGrams_)));
         }
-        return min;
+        result = std::exp(result);
+        return result / (1 + result);
     }
 
-    size_t get_bucket(std::string_view ngram, int is_spam, int seed) const {
-        return get_bucket(hash(ngram, seed), is_spam);
+    /** Count-min estimates of the current n-gram in spam and in ham. Both
+     * use the same hash per row, so each row is hashed once (`h` is the hash
+     * for row 0). */
+    template <typename Ngrams>
+    void count(const Ngrams& ngrams, size_t h, int& spam, int& ham) const {
+        spam = counts_[0][get_bucket(h, 1)];
+        ham = counts_[0][get_bucket(h, 0)];
+        for (int i = 1; i < num_hashes_; i++) {
+            h = ngrams.hash(i);
+            spam = std::min(spam, counts_[i][get_bucket(h, 1)]);
+            ham = std::min(ham, counts_[i][get_bucket(h, 0)]);
+        }
     }
 
     size_t get_bucket(size_t hash, int is_spam) const {
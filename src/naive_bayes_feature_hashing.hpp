@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
 #include <string_view>
 #include <vector>
 #include "email.hpp"
+#include "anytime.hpp"
 #include "base_classifier.hpp"
+#include "decayed_counts.hpp"
+#include "snapshot.hpp"
 
 namespace bdap {
 
@@ -19,6 +24,15 @@ class NaiveBayesFeatureHashing : public BaseClf<NaiveBayesFeatureHashing> {
     int nHamGrams_;
     std::vector<int> counts_;
 
+    // Only with `use_decay`: decayed counts instead of `counts_`, and the
+    // decayed totals (excluding the initial 1 of every count).
+    DecayedCounts decayed_;
+    double dSpam_ = 0.0, dHam_ = 0.0, dSpamGrams_ = 0.0, dHamGrams_ = 0.0;
+
+    // Only with `use_anytime_predict`: the largest ham and spam count.
+    AnytimePredict anytime_;
+    int maxCounts_[2] = {1, 1};
+
 public:
     /** Do not change the signature of the constructor! */
     NaiveBayesFeatureHashing(int ngram, int log_num_buckets)
@@ -34,14 +48,24 @@ public:
         counts_.resize((1 << log_num_buckets_) * 2, 1);
     }
 
-    void update_(const Email& email) {
+    int ngram() const { return ngram_; }
+
+    void require_hashes(HashSpec& spec) const { spec.require_seed(ngram_, seed_); }
+
+    template <typename E> // Email or HashedEmail
+    void update_(const E& email) {
+        if (decayed_.enabled())
+            return update_decayed(email);
         int isSpam = email.is_spam();
-        EmailIter allngrams(email, ngram_);
+        auto allngrams = ngrams_of(email, ngram_);
         if (isSpam) {
             ++nSpam_;
             while (allngrams)
             {
-                ++counts_[get_bucket(allngrams.next(), isSpam)];
+                allngrams.next();
+                int c = ++counts_[get_bucket(allngrams.hash(seed_), isSpam)];
+                if (anytime_.enabled)
+                    maxCounts_[isSpam] = std::max(maxCounts_[isSpam], c);
                 ++nSpamGrams_;
             }
         }
@@ -49,24 +73,33 @@ public:
             ++nHam_;
             while (allngrams)
             {
-                ++counts_[get_bucket(allngrams.next(), isSpam)];
+                allngrams.next();
+                int c = ++counts_[get_bucket(allngrams.hash(seed_), isSpam)];
+                if (anytime_.enabled)
+                    maxCounts_[isSpam] = std::max(maxCounts_[isSpam], c);
                 ++nHamGrams_;
             }
         }
     }
 
-    double predict_(const Email& email) const {
+    template <typename E>
+    double predict_(const E& email) const {
+        if (decayed_.enabled())
+            return predict_decayed(email);
+        if (anytime_.enabled)
+            return predict_anytime(email);
         //std::cout << "nSpam: " << nSpam_ << std::endl;
         //std::cout << "nHam: " << nHam_ << std::endl;
         double result = std::log((double)nSpam_ / (double)nHam_);
         //std::cout << "start result: " << result << ", before log: " << nSpam_ / nHam_ << std::endl;
-        EmailIter allngrams(email, ngram_);
-        std::string_view ngram;
+        auto allngrams = ngrams_of(email, ngram_);
+        size_t h;
         while (allngrams)
         {
-            ngram = allngrams.next();
-            result += std::log(((double)counts_[get_bucket(ngram, 1)] / (double)nSpamGrams_)
-                / ((double)counts_[get_bucket(ngram, 0)] / (double)nHamGrams_));
+            allngrams.next();
+            h = allngrams.hash(seed_);
+            result += std::log(((double)counts_[get_bucket(h, 1)] / (double)nSpamGrams_)
+                / ((double)counts_[get_bucket(h, 0)] / (double)nHamGrams_));
         }
         //std::cout << "result: " << result << std::endl;
         result = std::exp(result);
@@ -74,6 +107,86 @@ public:
         return result / (1 + result);
     }
 
+    /**
+     * Stop predictions early from now on (see `AnytimePredict`): once the
+     * remaining n-grams cannot change the classification, or after
+     * `max_ngrams` n-grams (0 for no limit). The bounds come from the largest
+     * spam and ham count, which `update` then keeps track of. Not combined
+     * with `use_decay`.
+     */
+    void use_anytime_predict(size_t max_ngrams = 0) {
+        if (decayed_.enabled())
+            throw std::logic_error("no anytime prediction with decay");
+        anytime_.enabled = true;
+        anytime_.max_ngrams = max_ngrams;
+        for (size_t i = 0; i < counts_.size(); ++i)
+            maxCounts_[i % 2] = std::max(maxCounts_[i % 2], counts_[i]);
+    }
+
+    /**
+     * Let all counts, and the email and n-gram totals, decay exponentially
+     * from now on: they lose half of their weight every `half_life` emails.
+     * Buckets are rescaled lazily when they are next touched (see
+     * `DecayedCounts`), at a granularity of `epoch_length` emails (default
+     * `half_life / 16`). The counts gathered so far are carried over.
+     * Calling it again with decay already on only changes the half-life and
+     * epoch length.
+     */
+    void use_decay(double half_life, uint32_t epoch_length = 0) {
+        if (anytime_.enabled)
+            throw std::logic_error("no decay with anytime prediction");
+        if (epoch_length == 0)
+            epoch_length = static_cast<uint32_t>(std::max(1.0, half_life / 16));
+        if (decayed_.enabled()) {
+            decayed_.retune(half_life, epoch_length, num_examples_processed);
+            return;
+        }
+        decayed_ = DecayedCounts(counts_.size(), half_life, epoch_length);
+        decayed_.advance(num_examples_processed);
+        for (size_t i = 0; i < counts_.size(); ++i)
+            decayed_.add(i, counts_[i] - 1);
+        dSpam_ = nSpam_ - 1;
+        dHam_ = nHam_ - 1;
+        dSpamGrams_ = nSpamGrams_ - 1;
+        dHamGrams_ = nHamGrams_ - 1;
+        counts_ = std::vector<int>();
+    }
+
+    /** Size of the count table in bytes. */
+    size_t memory_bytes() const
+    { return counts_.capacity() * sizeof(int) + decayed_.memory_bytes(); }
+
+    /** Write the model as a snapshot that `MappedModel` can map. */
+    void save(std::ostream& os) const {
+        if (decayed_.enabled())
+            throw std::logic_error("cannot save a model with decayed counts");
+        SnapshotHeader header = make_snapshot_header(
+                ModelKind::NaiveBayesFeatureHashing, hash_kind, ngram_, 1,
+                log_num_buckets_, seed_, threshold());
+        header.n_spam = nSpam_;
+        header.n_ham = nHam_;
+        header.n_spam_grams = nSpamGrams_;
+        header.n_ham_grams = nHamGrams_;
+        write_snapshot<int>(os, header, {&counts_});
+    }
+
+    /** Read a model written by `save`, to continue training it. The header
+     * was already read with `read_snapshot_header`. */
+    static NaiveBayesFeatureHashing load(const SnapshotHeader& header,
+                                         std::istream& is) {
+        NaiveBayesFeatureHashing clf{header.ngram, header.log_num_buckets};
+        if (header.seed != clf.seed_)
+            throw std::runtime_error("model snapshot with another hash seed");
+        read_snapshot<int>(is, header, ModelKind::NaiveBayesFeatureHashing,
+                           hash_kind, {&clf.counts_});
+        clf.nSpam_ = static_cast<int>(header.n_spam);
+        clf.nHam_ = static_cast<int>(header.n_ham);
+        clf.nSpamGrams_ = static_cast<int>(header.n_spam_grams);
+        clf.nHamGrams_ = static_cast<int>(header.n_ham_grams);
+        clf.num_examples_processed = clf.nSpam_ + clf.nHam_ - 2;
+        return clf;
+    }
+
     void printValues() {
         std::cout << "nSpam: " << nSpam_ << std::endl;
         std::cout << "nSpamGrams: " << nSpamGrams_ << std::endl;
@@ -87,8 +200,50 @@ public:
     }
 
 private:
-    size_t get_bucket(std::string_view ngram, int is_spam) const {
-        return get_bucket(hash(ngram, seed_), is_spam);
+    template <typename E>
+    double predict_anytime(const E& email) const {
+        // every count is in [1, maxCounts_]
+        double k = std::log((double)nHamGrams_ / (double)nSpamGrams_);
+        double result = anytime_sum(ngrams_of(email, ngram_),
+                std::log((double)nSpam_ / (double)nHam_), 0.0,
+                k - std::log((double)maxCounts_[0]), k + std::log((double)maxCounts_[1]),
+                anytime_, [this](const auto& ngrams) {
+                    size_t h = ngrams.hash(seed_);
+                    return std::log(((double)counts_[get_bucket(h, 1)] / (double)nSpamGrams_)
+                        / ((double)counts_[get_bucket(h, 0)] / (double)nHamGrams_));
+                });
+        result = std::exp(result);
+        return result / (1 + result);
+    }
+
+    template <typename E>
+    void update_decayed(const E& email) {
+        double f = decayed_.advance(num_examples_processed);
+        dSpam_ *= f; dHam_ *= f; dSpamGrams_ *= f; dHamGrams_ *= f;
+
+        int isSpam = email.is_spam();
+        double& grams = isSpam ? dSpamGrams_ : dHamGrams_;
+        ++(isSpam ? dSpam_ : dHam_);
+        auto allngrams = ngrams_of(email, ngram_);
+        while (allngrams) {
+            allngrams.next();
+            decayed_.add(get_bucket(allngrams.hash(seed_), isSpam));
+            ++grams;
+        }
+    }
+
+    template <typename E>
+    double predict_decayed(const E& email) const {
+        double result = std::log((1 + dSpam_) / (1 + dHam_));
+        auto allngrams = ngrams_of(email, ngram_);
+        while (allngrams) {
+            allngrams.next();
+            size_t h = allngrams.hash(seed_);
+            result += std::log(((1 + decayed_.get(get_bucket(h, 1))) / (1 + dSpamGrams_))
+                / ((1 + decayed_.get(get_bucket(h, 0))) / (1 + dHamGrams_)));
+        }
+        result = std::exp(result);
+        return result / (1 + result);
     }
 
     size_t get_bucket(size_t hash, int is_spam) const {
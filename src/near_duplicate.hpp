@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "email.hpp"
+#include "murmurhash.hpp"
+
+namespace bdap {
+
+/** A MinHash signature: per hash function, the smallest (upper 32 bits of
+ * the) hash of any shingle of the email. */
+using MinHashSignature = std::vector<uint32_t>;
+
+/** Shingles and LSH banding of a `NearDuplicateIndex`. */
+struct NearDuplicateConfig {
+    int shingle = 2;
+    int num_bands = 16;
+    int rows_per_band = 4;
+    double min_similarity = 0.8;
+};
+
+/**
+ * An index of recently scored emails that finds near duplicates of an email
+ * (campaign spam with a changed name or link) and reuses their score.
+ *
+ * Emails are compared by the Jaccard similarity of their sets of shingles,
+ * the word n-grams of `EmailIter` up to `shingle` words. A MinHash signature
+ * of `num_bands * rows_per_band` values estimates it: two emails agree on each
+ * value with probability (about) equal to their similarity. It is a
+ * one-permutation MinHash, so a signature costs a single `MurmurHash3_x64_128`
+ * per shingle: the first half of the hash picks a bin, the second half is the
+ * value, and each bin keeps its smallest value. Empty bins are filled from the
+ * next non-empty one (densification).
+ *
+ * Locality-sensitive hashing finds the candidates in time independent of the
+ * number of indexed emails: the signature is cut in bands, and every band is
+ * a key in a hash table of its own. Emails that share any band are
+ * candidates, which happens with probability `1 - (1 - s^rows)^bands` for
+ * similarity `s` (about 0.99 for `s = 0.8` and 0.04 for `s = 0.4` with the
+ * default 16 bands of 4 rows). A candidate is only used if its signature
+ * agrees with the email's on at least `min_similarity` of the values.
+ *
+ * Like `PredictionCache`, entries carry the version of the model that scored
+ * them and expire after `max_staleness` further updates. The index holds the
+ * last `capacity` inserted emails. All methods lock one mutex.
+ */
+class NearDuplicateIndex {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stale = 0;      // candidates too old for the model version
+        uint64_t candidates = 0; // signatures compared
+
+        double hit_rate() const
+        { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+private:
+    struct Entry {
+        uint64_t seq = 0;
+        uint64_t version = 0;
+        double score = 0.0;
+        MinHashSignature signature;
+        std::vector<uint64_t> band_keys;
+    };
+
+    NearDuplicateConfig config_;
+    uint64_t max_staleness_;
+    std::vector<Entry> entries_; // ring buffer, `seq % capacity`
+    uint64_t next_seq_ = 0;
+    // per band: band key -> seq of the last entry with that band
+    std::vector<std::unordered_map<uint64_t, uint64_t>> bands_;
+    Stats stats_;
+    mutable std::mutex mutex_;
+
+public:
+    explicit NearDuplicateIndex(size_t capacity, NearDuplicateConfig config = {},
+                                uint64_t max_staleness = 0)
+        : config_(config)
+        , max_staleness_(max_staleness)
+        , entries_(capacity)
+        , bands_(config.num_bands)
+    {
+        if (capacity == 0 || config.shingle < 1 || config.num_bands < 1
+                || config.rows_per_band < 1)
+            throw std::invalid_argument("invalid near-duplicate index config");
+    }
+
+    const NearDuplicateConfig& config() const { return config_; }
+
+    size_t signature_size() const
+    { return static_cast<size_t>(config_.num_bands) * config_.rows_per_band; }
+
+    /** The MinHash signature of `email`. Needs no lock. */
+    void signature(const Email& email, MinHashSignature& sig) const {
+        const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+        sig.assign(signature_size(), EMPTY);
+        for (EmailIter it(email, config_.shingle); it;) {
+            std::string_view shingle = it.next();
+            uint64_t h[2] = {0};
+            MurmurHash3_x64_128(shingle.data(), static_cast<int>(shingle.size()),
+                                0, &h);
+            uint32_t& bin = sig[h[0] % sig.size()];
+            bin = std::min(bin, static_cast<uint32_t>(h[1] >> 32));
+        }
+        // densify: an empty bin takes the value of the next non-empty bin,
+        // mixed with the distance so that the borrowed bins differ
+        size_t n = sig.size();
+        size_t j = 0;
+        while (j < n && sig[j] == EMPTY)
+            ++j;
+        if (j == n)
+            return; // no shingles
+        uint32_t src = sig[j];
+        uint64_t dist = 0;
+        for (size_t step = 1; step < n; ++step) {
+            uint32_t& bin = sig[(j + n - step) % n];
+            if (bin != EMPTY) {
+                src = bin;
+                dist = 0;
+            } else {
+                bin = static_cast<uint32_t>(fmix64(src + (++dist << 32)));
+            }
+        }
+    }
+
+    /** The score of the most similar indexed near duplicate of the email with
+     * signature `sig`, if there is one that is fresh enough for a model at
+     * `version`. */
+    bool find(const MinHashSignature& sig, uint64_t version, double& score,
+              double *similarity = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Entry *best = nullptr;
+        double best_similarity = 0.0;
+        uint64_t checked[64];
+        size_t num_checked = 0;
+        for (int b = 0; b < config_.num_bands; ++b) {
+            auto it = bands_[b].find(band_key(sig, b));
+            if (it == bands_[b].end())
+                continue;
+            uint64_t seq = it->second;
+            if (std::find(checked, checked + num_checked, seq)
+                    != checked + num_checked)
+                continue;
+            if (num_checked < 64)
+                checked[num_checked++] = seq;
+            const Entry& e = entries_[seq % entries_.size()];
+            if (e.version + max_staleness_ < version) {
+                ++stats_.stale;
+                continue;
+            }
+            ++stats_.candidates;
+            double s = agreement(sig, e.signature);
+            if (s > best_similarity) {
+                best = &e;
+                best_similarity = s;
+            }
+        }
+        if (best == nullptr || best_similarity < config_.min_similarity) {
+            ++stats_.misses;
+            return false;
+        }
+        ++stats_.hits;
+        score = best->score;
+        if (similarity)
+            *similarity = best_similarity;
+        return true;
+    }
+
+    /** Index the email with signature `sig`, scored `score` by a model at
+     * `version`, evicting the oldest entry if the index is full. */
+    void insert(const MinHashSignature& sig, uint64_t version, double score) {
+        if (sig.size() != signature_size())
+            throw std::invalid_argument("signature size mismatch");
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t seq = next_seq_++;
+        Entry& e = entries_[seq % entries_.size()];
+        if (!e.band_keys.empty()) { // evict, unless a newer entry took the band
+            for (int b = 0; b < config_.num_bands; ++b) {
+                auto it = bands_[b].find(e.band_keys[b]);
+                if (it != bands_[b].end() && it->second == e.seq)
+                    bands_[b].erase(it);
+            }
+        }
+        e.seq = seq;
+        e.version = version;
+        e.score = score;
+        e.signature = sig;
+        e.band_keys.resize(config_.num_bands);
+        for (int b = 0; b < config_.num_bands; ++b) {
+            e.band_keys[b] = band_key(sig, b);
+            bands_[b][e.band_keys[b]] = seq;
+        }
+    }
+
+    /** `clf.predict(email)`, from a near duplicate if possible. */
+    template <typename Clf>
+    double predict(const Clf& clf, const Email& email) {
+        uint64_t version = static_cast<uint64_t>(clf.num_examples_processed);
+        MinHashSignature sig;
+        signature(email, sig);
+        double score;
+        if (!find(sig, version, score)) {
+            score = clf.predict(email);
+            insert(sig, version, score);
+        }
+        return score;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<size_t>(std::min<uint64_t>(next_seq_, entries_.size()));
+    }
+
+private:
+    uint64_t band_key(const MinHashSignature& sig, int band) const {
+        uint64_t key = fmix64(static_cast<uint64_t>(band) + 1);
+        const uint32_t *rows = sig.data() + band * config_.rows_per_band;
+        for (int r = 0; r < config_.rows_per_band; ++r)
+            key = fmix64(key ^ rows[r]);
+        return key;
+    }
+
+    static double agreement(const MinHashSignature& a, const MinHashSignature& b) {
+        size_t same = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            same += a[i] == b[i];
+        return a.empty() ? 1.0 : double(same) / a.size();
+    }
+};
+
+} // namespace bdap
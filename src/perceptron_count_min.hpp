@@ -1,12 +1,17 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <numeric>
 #include <string_view>
 #include <vector>
 #include "email.hpp"
+#include "anytime.hpp"
 #include "base_classifier.hpp"
+#include "hot_table.hpp"
+#include "margin_updates.hpp"
+#include "snapshot.hpp"
 
 namespace bdap {
 
@@ -18,6 +23,21 @@ class PerceptronCountMin : public BaseClf<PerceptronCountMin> {
     double bias_;
     std::vector<std::vector<double>> weights_;
 
+    HotTable<double> hot_; // disabled unless `use_hot_table`
+    std::vector<uint32_t> freq_; // occurrences per bucket of row 0, for promotion
+    uint32_t promote_at_ = 0;
+    std::vector<uint64_t> hot_hits_; // scratch for `update_`
+
+    // Only with `use_anytime_predict`: a bound on the magnitude of every
+    // weight (and hot weight).
+    AnytimePredict anytime_;
+    double maxWeight_ = 0.0;
+
+    MarginUpdates margin_; // disabled unless `use_margin_updates`
+    uint64_t num_skipped_updates_ = 0;
+    std::vector<int> buckets_; // scratch for `update_`, [n-gram][row]
+    std::vector<int> row_buckets_;
+
 public:
     /** Do not change the signature of the constructor! */
     PerceptronCountMin(int ngram, int num_hashes, int log_num_buckets,
@@ -32,37 +52,104 @@ public:
         weights_.resize(num_hashes_, std::vector<double>((1 << log_num_buckets_), 0.0));
     }
 
-    void update_(const Email& email) {
+    int ngram() const { return ngram_; }
+
+    void require_hashes(HashSpec& spec) const { spec.require_seq(ngram_, num_hashes_); }
+
+    template <typename E> // Email or HashedEmail
+    void update_(const E& email) {
         int isSpam = email.is_spam() * 2 - 1;
-        EmailIter allngrams(email, ngram_);
-        std::vector<std::vector<double>> w (num_hashes_, std::vector<double>(1 << log_num_buckets_, 0.0));
+        auto allngrams = ngrams_of(email, ngram_);
         int bucket;
         std::vector<double> h (num_hashes_, 0.0);
-        std::string_view ngram;
+        buckets_.clear();
+        hot_hits_.clear();
         while (allngrams) {
-            ngram = allngrams.next();
+            allngrams.next();
+            size_t fingerprint = allngrams.hash(0);
+            double w_avg = 0.0;
             for (int i = 0; i < num_hashes_; i++) {
-                bucket = get_bucket(ngram, i);
-                ++w[i][bucket];
+                bucket = get_bucket(i == 0 ? fingerprint : allngrams.hash(i));
+                buckets_.push_back(bucket);
                 h[i] += weights_[i][bucket];
+                w_avg += weights_[i][bucket];
+            }
+            if (hot_.enabled()) {
+                if (hot_.touch(fingerprint)) {
+                    hot_hits_.push_back(fingerprint);
+                } else if (++freq_[get_bucket(fingerprint)] >= promote_at_
+                        && (hot_.size() < hot_.capacity()
+                            || (freq_[get_bucket(fingerprint)] & 15) == 0)) {
+                    hot_.insert(fingerprint, w_avg / num_hashes_);
+                    hot_hits_.push_back(fingerprint);
+                }
+            }
+        }
+        // the activation of `predict_` (without the hot table)
+        double a = std::accumulate(h.begin(), h.end(), 0.0) / num_hashes_;
+        if (margin_.skip(isSpam, a)) {
+            ++num_skipped_updates_;
+            return;
+        }
+        // per row, a gradient step on (isSpam - tanh(h[i]))^2 / 2, or one
+        // passive-aggressive step on the average of the rows
+        std::vector<double> step (num_hashes_, 0.0);
+        if (margin_.passive_aggressive()) {
+            double sq_norm = 0.0;
+            for (int i = 0; i < num_hashes_; i++) {
+                row_buckets_.clear();
+                for (size_t j = i; j < buckets_.size(); j += num_hashes_)
+                    row_buckets_.push_back(buckets_[j]);
+                sq_norm += sum_sq_counts(row_buckets_);
+            }
+            sq_norm /= double(num_hashes_) * num_hashes_;
+            double tau = margin_.pa_step(isSpam, a, sq_norm);
+            std::fill(step.begin(), step.end(), isSpam * tau / num_hashes_);
+        } else {
+            for (int i = 0; i < num_hashes_; i++) {
+                double h_i = tanh(h[i]);
+                step[i] = learning_rate_ * (isSpam - h_i) * (1 - h_i * h_i);
             }
         }
-        for (int i = 0; i < num_hashes_; i++) {
-            h[i] = tanh(h[i]);
-            scalarMulVector(w[i], learning_rate_ * (isSpam - h[i]) * (1 - h[i] * h[i]));
-            vectorSub(weights_[i], w[i]);
+        for (size_t j = 0; j < buckets_.size(); ++j)
+            weights_[j % num_hashes_][buckets_[j]] += step[j % num_hashes_];
+        // the hot weights follow the average of the rows, without collisions
+        double step_avg = std::accumulate(step.begin(), step.end(), 0.0) / num_hashes_;
+        for (uint64_t fingerprint : hot_hits_) {
+            if (double *hot = hot_.touch(fingerprint)) {
+                *hot += step_avg;
+                if (anytime_.enabled)
+                    maxWeight_ = std::max(maxWeight_, std::abs(*hot));
+            }
         }
+        if (anytime_.enabled)
+            for (size_t j = 0; j < buckets_.size(); ++j)
+                maxWeight_ = std::max(maxWeight_,
+                                      std::abs(weights_[j % num_hashes_][buckets_[j]]));
     }
 
-    double predict_(const Email& email) const {
-        EmailIter allngrams(email, ngram_);
+    template <typename E>
+    double predict_(const E& email) const {
+        if (anytime_.enabled) {
+            return tanh(anytime_sum(ngrams_of(email, ngram_), 0.0, 0.0,
+                    -maxWeight_, maxWeight_, anytime_, [this](const auto& ngrams) {
+                        return weight(ngrams);
+                    }));
+        }
+        auto allngrams = ngrams_of(email, ngram_);
         double h = 0.0;
         double h_i = 0.0;
-        std::string_view ngram;
         while (allngrams) {
-            ngram = allngrams.next();
-            for (int i = 0; i < num_hashes_; i++) {
-                h_i += weights_[i][get_bucket(ngram, i)];
+            allngrams.next();
+            size_t fingerprint = allngrams.hash(0);
+            const double *hot = hot_.enabled() ? hot_.find(fingerprint) : nullptr;
+            if (hot) {
+                h += *hot;
+                continue;
+            }
+            h_i = weights_[0][get_bucket(fingerprint)];
+            for (int i = 1; i < num_hashes_; i++) {
+                h_i += weights_[i][get_bucket(allngrams.hash(i))];
             }
             h += h_i / num_hashes_;
             h_i = 0.0;
@@ -70,22 +157,115 @@ public:
         return tanh(h);
     }
 
-private:
-    size_t get_bucket(std::string_view ngram, int seed) const {
-        return get_bucket(hash(ngram, seed));
+    /**
+     * Keep exact weights for up to `capacity` hot n-grams from now on. An
+     * n-gram is promoted once `promote_at` n-grams were seen in its bucket of
+     * the first row (once full, checked every 16th occurrence, replacing an
+     * n-gram that was not used recently), starting from its average weight
+     * at that time. Predictions for hot n-grams then take one hash and one
+     * probe into a small table instead of `num_hashes` probes into the
+     * sketch.
+     *
+     * The sketch is still updated for all n-grams, and it is all that `save`
+     * writes, so a `MappedModel` of the snapshot only approximates this
+     * model's predictions.
+     */
+    void use_hot_table(size_t capacity, uint32_t promote_at = 64) {
+        hot_ = HotTable<double>(capacity);
+        freq_.assign(capacity > 0 ? size_t(1) << log_num_buckets_ : 0, 0);
+        promote_at_ = promote_at;
     }
 
-    size_t get_bucket(size_t hash) const {
-        hash &= (1 << log_num_buckets_) - 1;
-        return hash;
+    /**
+     * Stop predictions early from now on (see `AnytimePredict`): once the
+     * remaining n-grams cannot change the classification, or after
+     * `max_ngrams` n-grams (0 for no limit). The bounds come from the
+     * largest weight magnitude in any row or in the hot table, which
+     * `update` then keeps track of (as an upper bound: it never shrinks).
+     */
+    void use_anytime_predict(size_t max_ngrams = 0) {
+        anytime_.enabled = true;
+        anytime_.max_ngrams = max_ngrams;
+        for (const auto& row : weights_)
+            for (double w : row)
+                maxWeight_ = std::max(maxWeight_, std::abs(w));
+        hot_.for_each([this](uint64_t, double w) {
+            maxWeight_ = std::max(maxWeight_, std::abs(w));
+        });
+    }
+
+    /**
+     * Skip the updates on emails classified correctly with activation
+     * margin `margin` from now on (see `MarginUpdates`), and with
+     * `aggressiveness > 0`, make passive-aggressive steps of at most that
+     * size instead of gradient steps. The activation is that of `predict`
+     * without the hot table: the average of the rows.
+     */
+    void use_margin_updates(double margin, double aggressiveness = 0.0) {
+        margin_.enabled = true;
+        margin_.margin = margin;
+        margin_.aggressiveness = aggressiveness;
+    }
+
+    /** Number of `update` calls that did not change the model. */
+    uint64_t num_skipped_updates() const { return num_skipped_updates_; }
+
+    double skipped_update_fraction() const {
+        return num_examples_processed
+            ? double(num_skipped_updates_) / num_examples_processed : 0.0;
+    }
+
+    /** Size of the weight tables (and hot table) in bytes. */
+    size_t memory_bytes() const {
+        size_t bytes = weights_.capacity() * sizeof(std::vector<double>)
+            + hot_.memory_bytes() + freq_.capacity() * sizeof(uint32_t);
+        for (const auto& row : weights_)
+            bytes += row.capacity() * sizeof(double);
+        return bytes;
     }
 
-    void scalarMulVector(std::vector<double>& v, double k) {
-        std::transform(v.begin(), v.end(), v.begin(), [k](double& c) { return c * k; });
+    /** Write the model as a snapshot that `MappedModel` can map. */
+    void save(std::ostream& os) const {
+        SnapshotHeader header = make_snapshot_header(
+                ModelKind::PerceptronCountMin, hash_kind, ngram_, num_hashes_,
+                log_num_buckets_, 0, threshold());
+        std::vector<const std::vector<double> *> rows;
+        for (const auto& row : weights_)
+            rows.push_back(&row);
+        write_snapshot(os, header, rows);
     }
 
-    void vectorSub(std::vector<double>& v1, std::vector<double>& v2) {
-        std::transform(v1.begin(), v1.end(), v2.begin(), v1.begin(), [](double a, double b) { return a - b; });
+    /** Read a model written by `save`, to continue training it with
+     * `learning_rate` (which the snapshot does not store). The header was
+     * already read with `read_snapshot_header`. */
+    static PerceptronCountMin load(const SnapshotHeader& header,
+                                   std::istream& is, double learning_rate) {
+        PerceptronCountMin clf{header.ngram, header.num_hashes,
+                               header.log_num_buckets, learning_rate};
+        std::vector<std::vector<double> *> rows;
+        for (auto& row : clf.weights_)
+            rows.push_back(&row);
+        read_snapshot(is, header, ModelKind::PerceptronCountMin, hash_kind, rows);
+        return clf;
+    }
+
+private:
+    /** The weight of the current n-gram of `ngrams`, as in `predict_`. */
+    template <typename Ngrams>
+    double weight(const Ngrams& ngrams) const {
+        size_t fingerprint = ngrams.hash(0);
+        if (hot_.enabled())
+            if (const double *hot = hot_.find(fingerprint))
+                return *hot;
+        double w = weights_[0][get_bucket(fingerprint)];
+        for (int i = 1; i < num_hashes_; i++)
+            w += weights_[i][get_bucket(ngrams.hash(i))];
+        return w / num_hashes_;
+    }
+
+    size_t get_bucket(size_t hash) const {
+        hash &= (1 << log_num_buckets_) - 1;
+        return hash;
     }
 };
 
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
 #include <string_view>
 #include <vector>
 #include "email.hpp"
+#include "anytime.hpp"
 #include "base_classifier.hpp"
+#include "margin_updates.hpp"
+#include "snapshot.hpp"
 
 namespace bdap {
 
@@ -17,6 +23,15 @@ class PerceptronFeatureHashing : public BaseClf<PerceptronFeatureHashing> {
 
     int seed_;
 
+    // Only with `use_anytime_predict`: a bound on the magnitude of every
+    // weight.
+    AnytimePredict anytime_;
+    double maxWeight_ = 0.0;
+
+    MarginUpdates margin_; // disabled unless `use_margin_updates`
+    uint64_t num_skipped_updates_ = 0;
+    std::vector<int> buckets_; // scratch for `update_`, one per n-gram
+
 public:
     /** Do not change the signature of the constructor! */
     PerceptronFeatureHashing(int ngram, int log_num_buckets, double learning_rate)
@@ -31,55 +46,122 @@ public:
         weights_.resize(1 << log_num_buckets_, 0.0);
     }
 
-    void update_(const Email& email) {
+    int ngram() const { return ngram_; }
+
+    void require_hashes(HashSpec& spec) const { spec.require_seed(ngram_, seed_); }
+
+    template <typename E> // Email or HashedEmail
+    void update_(const E& email) {
         int isSpam = email.is_spam() * 2 - 1;
-        std::cout << "IsSpam: " << isSpam << std::endl;
-        EmailIter allngrams(email, ngram_);
-        std::vector<double> w (1 << log_num_buckets_, 0.0);
-        int bucket;
-        double h = 0.0;
+        auto allngrams = ngrams_of(email, ngram_);
+        buckets_.clear();
+        double a = 0.0;
         while (allngrams) {
-            bucket = get_bucket(allngrams.next());
-            ++w[bucket];
-            h += weights_[bucket];
+            allngrams.next();
+            int bucket = static_cast<int>(get_bucket(allngrams.hash(seed_)));
+            buckets_.push_back(bucket);
+            a += weights_[bucket];
+        }
+        if (margin_.skip(isSpam, a)) {
+            ++num_skipped_updates_;
+            return;
         }
-        h = tanh(h);
-        //std::cout << "Predict: " << h << std::endl;
-        scalarMulVector(w, learning_rate_ * (isSpam - h) * (1 - h * h));
-        //scalarMulVector(w, learning_rate_ * (isSpam - h));
-        //std::cout << "update: [";
-        //for (int i; i < (1 << log_num_buckets_); i++) {
-        //    std::cout << w[i] << ", ";
-        //}
-        //std::cout << "]" << std::endl;
-        vectorSub(weights_, w);
+        // gradient step on (isSpam - tanh(a))^2 / 2, or passive-aggressive
+        double step;
+        if (margin_.passive_aggressive()) {
+            step = isSpam * margin_.pa_step(isSpam, a, sum_sq_counts(buckets_));
+        } else {
+            double h = tanh(a);
+            step = learning_rate_ * (isSpam - h) * (1 - h * h);
+        }
+        for (int b : buckets_)
+            weights_[b] += step;
+        if (anytime_.enabled)
+            for (int b : buckets_)
+                maxWeight_ = std::max(maxWeight_, std::abs(weights_[b]));
     }
 
-    double predict_(const Email& email) const {
-        EmailIter allngrams(email, ngram_);
+    template <typename E>
+    double predict_(const E& email) const {
+        if (anytime_.enabled) {
+            return tanh(anytime_sum(ngrams_of(email, ngram_), 0.0, 0.0,
+                    -maxWeight_, maxWeight_, anytime_, [this](const auto& ngrams) {
+                        return weights_[get_bucket(ngrams.hash(seed_))];
+                    }));
+        }
+        auto allngrams = ngrams_of(email, ngram_);
         double h = 0.0;
         while (allngrams) {
-            h += weights_[get_bucket(allngrams.next())];
+            allngrams.next();
+            h += weights_[get_bucket(allngrams.hash(seed_))];
         }
         return tanh(h);
     }
 
+    /**
+     * Stop predictions early from now on (see `AnytimePredict`): once the
+     * remaining n-grams cannot change the classification, or after
+     * `max_ngrams` n-grams (0 for no limit). The bounds come from the
+     * largest weight magnitude, which `update` then keeps track of (as an
+     * upper bound: it never shrinks).
+     */
+    void use_anytime_predict(size_t max_ngrams = 0) {
+        anytime_.enabled = true;
+        anytime_.max_ngrams = max_ngrams;
+        for (double w : weights_)
+            maxWeight_ = std::max(maxWeight_, std::abs(w));
+    }
 
-private:
-    size_t get_bucket(std::string_view ngram) const
-    { return get_bucket(hash(ngram, seed_)); }
+    /**
+     * Skip the updates on emails classified correctly with activation
+     * margin `margin` from now on (see `MarginUpdates`), and with
+     * `aggressiveness > 0`, make passive-aggressive steps of at most that
+     * size instead of gradient steps.
+     */
+    void use_margin_updates(double margin, double aggressiveness = 0.0) {
+        margin_.enabled = true;
+        margin_.margin = margin;
+        margin_.aggressiveness = aggressiveness;
+    }
 
-    size_t get_bucket(size_t hash) const {
-        hash &= (1 << log_num_buckets_) - 1;
-        return hash;
+    /** Number of `update` calls that did not change the model. */
+    uint64_t num_skipped_updates() const { return num_skipped_updates_; }
+
+    double skipped_update_fraction() const {
+        return num_examples_processed
+            ? double(num_skipped_updates_) / num_examples_processed : 0.0;
     }
 
-    void scalarMulVector(std::vector<double>& v, double k) {
-        std::transform(v.begin(), v.end(), v.begin(), [k](double& c) { return c * k; });
+    /** Size of the weight table in bytes. */
+    size_t memory_bytes() const { return weights_.capacity() * sizeof(double); }
+
+    /** Write the model as a snapshot that `MappedModel` can map. */
+    void save(std::ostream& os) const {
+        SnapshotHeader header = make_snapshot_header(
+                ModelKind::PerceptronFeatureHashing, hash_kind, ngram_, 1,
+                log_num_buckets_, seed_, threshold());
+        write_snapshot<double>(os, header, {&weights_});
     }
 
-    void vectorSub(std::vector<double>& v1, std::vector<double>& v2) {
-        std::transform(v1.begin(), v1.end(), v2.begin(), v1.begin(), [](double a, double b) { return a - b; });
+    /** Read a model written by `save`, to continue training it with
+     * `learning_rate` (which the snapshot does not store). The header was
+     * already read with `read_snapshot_header`. */
+    static PerceptronFeatureHashing load(const SnapshotHeader& header,
+                                         std::istream& is,
+                                         double learning_rate) {
+        PerceptronFeatureHashing clf{header.ngram, header.log_num_buckets,
+                                     learning_rate};
+        if (header.seed != clf.seed_)
+            throw std::runtime_error("model snapshot with another hash seed");
+        read_snapshot<double>(is, header, ModelKind::PerceptronFeatureHashing,
+                              hash_kind, {&clf.weights_});
+        return clf;
+    }
+
+private:
+    size_t get_bucket(size_t hash) const {
+        hash &= (1 << log_num_buckets_) - 1;
+        return hash;
     }
 };
 
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Optional hardware performance counters (Linux `perf_event_open`).
+ *
+ * Enable with BDAP_PERF_COUNTERS=1 (CMake cache variable). On other platforms,
+ * or when the kernel refuses the events (e.g., `perf_event_paranoid` or a
+ * virtual machine without a PMU), the counters report as unavailable and
+ * nothing is measured.
+ */
+#ifndef BDAP_PERF_COUNTERS
+#define BDAP_PERF_COUNTERS 0
+#endif
+
+namespace bdap {
+
+enum class PerfEvent : int {
+    Cycles, Instructions, L1dMisses, LlcMisses, DtlbMisses,
+    NumEvents
+};
+
+constexpr int NUM_PERF_EVENTS = static_cast<int>(PerfEvent::NumEvents);
+
+inline const char *perf_event_name(PerfEvent event) {
+    switch (event) {
+    case PerfEvent::Cycles: return "cycles";
+    case PerfEvent::Instructions: return "instructions";
+    case PerfEvent::L1dMisses: return "l1d_misses";
+    case PerfEvent::LlcMisses: return "llc_misses";
+    case PerfEvent::DtlbMisses: return "dtlb_misses";
+    default: return "?";
+    }
+}
+
+struct PerfCounts {
+    uint64_t value[NUM_PERF_EVENTS] = {0};
+    bool valid[NUM_PERF_EVENTS] = {false};
+
+    uint64_t operator[](PerfEvent e) const { return value[static_cast<int>(e)]; }
+
+    PerfCounts& operator+=(const PerfCounts& o) {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+            value[e] += o.value[e];
+            valid[e] = valid[e] || o.valid[e];
+        }
+        return *this;
+    }
+};
+
+/**
+ * A group of counters for the calling thread, scheduled together on the PMU
+ * so that the counts of one `start`/`stop` interval are consistent. Counts
+ * are scaled up when the kernel multiplexed the group.
+ */
+class PerfCounters {
+    int fds_[NUM_PERF_EVENTS];
+    uint64_t ids_[NUM_PERF_EVENTS] = {0};
+    int leader_ = -1;
+    std::string error_;
+
+public:
+    PerfCounters() {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+            fds_[e] = -1;
+#if defined(__linux__)
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            config(static_cast<PerfEvent>(e), attr);
+            attr.disabled = leader_ == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID
+                | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = static_cast<int>(
+                    syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+            if (fd < 0) {
+                if (error_.empty())
+                    error_ = std::string(perf_event_name(static_cast<PerfEvent>(e)))
+                        + ": " + std::strerror(errno);
+                continue;
+            }
+            fds_[e] = fd;
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids_[e]);
+            if (leader_ == -1)
+                leader_ = fd;
+        }
+#else
+        error_ = "perf_event_open is only available on Linux";
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    /** True if at least one event could be opened. */
+    bool available() const { return leader_ != -1; }
+
+    /** The reason why the first unavailable event could not be opened. */
+    const std::string& error() const { return error_; }
+
+    void start() {
+#if defined(__linux__)
+        if (!available()) return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    PerfCounts stop() {
+        PerfCounts counts;
+#if defined(__linux__)
+        if (!available()) return counts;
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, time_enabled, time_running, {value, id} * nr
+        uint64_t buf[3 + 2 * NUM_PERF_EVENTS];
+        if (read(leader_, buf, sizeof(buf)) < 0)
+            return counts;
+        uint64_t nr = buf[0];
+        double scale = buf[2] > 0 ? static_cast<double>(buf[1]) / buf[2] : 0.0;
+        for (uint64_t i = 0; i < nr && i < NUM_PERF_EVENTS; ++i) {
+            for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+                if (fds_[e] >= 0 && ids_[e] == buf[3 + 2*i + 1]) {
+                    counts.value[e] = static_cast<uint64_t>(buf[3 + 2*i] * scale);
+                    counts.valid[e] = true;
+                }
+            }
+        }
+#endif
+        return counts;
+    }
+
+private:
+#if defined(__linux__)
+    static void config(PerfEvent event, perf_event_attr& attr) {
+        auto cache = [](uint64_t cache, uint64_t op, uint64_t result) {
+            return cache | (op << 8) | (result << 16);
+        };
+        switch (event) {
+        case PerfEvent::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1dMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_L1D,
+                    PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        case PerfEvent::LlcMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::DtlbMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cache(PERF_COUNT_HW_CACHE_DTLB,
+                    PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            break;
+        default:
+            break;
+        }
+    }
+#endif
+};
+
+} // namespace bdap
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "email.hpp"
+#include "murmurhash.hpp"
+
+namespace bdap {
+
+/** 128-bit MurmurHash3 of an email body. */
+struct BodyFingerprint {
+    uint64_t lo = 0, hi = 0;
+
+    static BodyFingerprint of(std::string_view body) {
+        uint64_t out[2] = {0};
+        MurmurHash3_x64_128(body.data(), static_cast<int>(body.size()),
+                            0x5eed5eed, &out);
+        return {out[0], out[1]};
+    }
+
+    bool operator==(const BodyFingerprint& o) const
+    { return lo == o.lo && hi == o.hi; }
+};
+
+/**
+ * A bounded cache of predictions of exact duplicate emails, keyed by the
+ * fingerprint of the body.
+ *
+ * Every prediction is stored with the version of the model that made it
+ * (the number of updates it had seen, e.g., `num_examples_processed`). A
+ * lookup with a newer model version only hits if the entry is at most
+ * `max_staleness` updates old, so with the default 0 every `update`
+ * invalidates the whole cache, lazily.
+ *
+ * The cache is split into shards by fingerprint, each with its own lock and
+ * least-recently-used eviction, so that threads scoring different emails
+ * rarely contend. A lookup costs one hash of the body, which callers that
+ * still have the raw body can compute before tokenizing (see
+ * `find(BodyFingerprint, ...)`).
+ */
+class PredictionCache {
+    struct Entry {
+        BodyFingerprint key;
+        double score;
+        uint64_t version;
+    };
+
+    struct KeyHash {
+        size_t operator()(const BodyFingerprint& k) const
+        { return static_cast<size_t>(k.hi); }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<BodyFingerprint, std::list<Entry>::iterator, KeyHash> index;
+        uint64_t hits = 0, misses = 0, stale = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_capacity_;
+    uint64_t max_staleness_;
+
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0; // including the stale entries
+        uint64_t stale = 0;
+
+        double hit_rate() const
+        { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+    explicit PredictionCache(size_t capacity, size_t num_shards = 16,
+                             uint64_t max_staleness = 0)
+        : max_staleness_(max_staleness)
+    {
+        num_shards = std::max<size_t>(1, std::min(num_shards, capacity));
+        shard_capacity_ = (capacity + num_shards - 1) / num_shards;
+        for (size_t i = 0; i < num_shards; ++i)
+            shards_.push_back(std::make_unique<Shard>());
+    }
+
+    /** The cached score of the body with fingerprint `key` for a model at
+     * `version`, if there is a fresh enough one. */
+    bool find(const BodyFingerprint& key, uint64_t version, double& score) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++shard.misses;
+            return false;
+        }
+        const Entry& e = *it->second;
+        if (e.version + max_staleness_ < version) {
+            ++shard.misses;
+            ++shard.stale;
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+            return false;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        ++shard.hits;
+        score = e.score;
+        return true;
+    }
+
+    /** Remember `score`, made by a model at `version`. */
+    void insert(const BodyFingerprint& key, uint64_t version, double score) {
+        if (shard_capacity_ == 0)
+            return;
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            Entry& e = *it->second;
+            if (version >= e.version) {
+                e.score = score;
+                e.version = version;
+            }
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return;
+        }
+        if (shard.lru.size() >= shard_capacity_) {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+        }
+        shard.lru.push_front({key, score, version});
+        shard.index.emplace(key, shard.lru.begin());
+    }
+
+    /** `clf.predict(email)`, from the cache if possible. */
+    template <typename Clf>
+    double predict(const Clf& clf, const Email& email) {
+        uint64_t version = static_cast<uint64_t>(clf.num_examples_processed);
+        BodyFingerprint key = BodyFingerprint::of(email.body());
+        double score;
+        if (!find(key, version, score)) {
+            score = clf.predict(email);
+            insert(key, version, score);
+        }
+        return score;
+    }
+
+    Stats stats() const {
+        Stats s;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            s.hits += shard->hits;
+            s.misses += shard->misses;
+            s.stale += shard->stale;
+        }
+        return s;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            n += shard->lru.size();
+        }
+        return n;
+    }
+
+private:
+    Shard& shard_of(const BodyFingerprint& key)
+    { return *shards_[key.lo % shards_.size()]; }
+};
+
+} // namespace bdap
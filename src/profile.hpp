@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Compile-time switchable hot path instrumentation.
+ *
+ *  - BDAP_PROFILE=0 (default): all instrumentation compiles to nothing.
+ *  - BDAP_PROFILE=1: count and time the coarse phases (parse, tokenize,
+ *    predict, update, metric) and count hash calls and hashed bytes.
+ *  - BDAP_PROFILE=2: additionally time every single hash call. A hash is only
+ *    a few ns, so this inflates the hash time with the timer overhead.
+ *
+ * Times are inclusive: predict includes the hashing it does, and metric
+ * includes the prediction it makes. The statistics are thread local.
+ */
+#ifndef BDAP_PROFILE
+#define BDAP_PROFILE 0
+#endif
+
+namespace bdap {
+
+enum class Phase : int {
+    Parse, Tokenize, Hash, Predict, Update, Metric,
+    NumPhases
+};
+
+constexpr int NUM_PHASES = static_cast<int>(Phase::NumPhases);
+
+inline const char *phase_name(Phase phase) {
+    switch (phase) {
+    case Phase::Parse: return "parse";
+    case Phase::Tokenize: return "tokenize";
+    case Phase::Hash: return "hash";
+    case Phase::Predict: return "predict";
+    case Phase::Update: return "update";
+    case Phase::Metric: return "metric";
+    default: return "?";
+    }
+}
+
+struct PhaseStats {
+    uint64_t count[NUM_PHASES] = {0};
+    uint64_t ns[NUM_PHASES] = {0};
+    uint64_t bytes[NUM_PHASES] = {0};
+
+    PhaseStats& operator-=(const PhaseStats& o) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            count[p] -= o.count[p];
+            ns[p] -= o.ns[p];
+            bytes[p] -= o.bytes[p];
+        }
+        return *this;
+    }
+
+    PhaseStats& operator+=(const PhaseStats& o) {
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            count[p] += o.count[p];
+            ns[p] += o.ns[p];
+            bytes[p] += o.bytes[p];
+        }
+        return *this;
+    }
+};
+
+/** The statistics of the calling thread. */
+inline PhaseStats& phase_stats() {
+    thread_local PhaseStats stats;
+    return stats;
+}
+
+/** Adds the lifetime of the timer to `phase`. */
+class PhaseTimer {
+    Phase phase_;
+    uint64_t bytes_;
+    std::chrono::steady_clock::time_point begin_;
+
+public:
+    PhaseTimer(Phase phase, uint64_t bytes = 0)
+        : phase_(phase), bytes_(bytes), begin_(std::chrono::steady_clock::now()) {}
+
+    ~PhaseTimer() {
+        auto end = std::chrono::steady_clock::now();
+        PhaseStats& stats = phase_stats();
+        int p = static_cast<int>(phase_);
+        ++stats.count[p];
+        stats.bytes[p] += bytes_;
+        stats.ns[p] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - begin_).count();
+    }
+};
+
+inline void phase_count(Phase phase, uint64_t bytes) {
+    PhaseStats& stats = phase_stats();
+    ++stats.count[static_cast<int>(phase)];
+    stats.bytes[static_cast<int>(phase)] += bytes;
+}
+
+} // namespace bdap
+
+#define BDAP_CONCAT_(a, b) a##b
+#define BDAP_CONCAT(a, b) BDAP_CONCAT_(a, b)
+
+#if BDAP_PROFILE
+#define BDAP_PROFILE_SCOPE(phase, bytes) \
+    ::bdap::PhaseTimer BDAP_CONCAT(bdap_phase_timer_, __LINE__)(phase, bytes)
+#else
+#define BDAP_PROFILE_SCOPE(phase, bytes) ((void)0)
+#endif
+
+#if BDAP_PROFILE >= 2
+#define BDAP_PROFILE_HASH(bytes) BDAP_PROFILE_SCOPE(::bdap::Phase::Hash, bytes)
+#elif BDAP_PROFILE
+#define BDAP_PROFILE_HASH(bytes) ::bdap::phase_count(::bdap::Phase::Hash, bytes)
+#else
+#define BDAP_PROFILE_HASH(bytes) ((void)0)
+#endif
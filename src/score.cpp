@@ -0,0 +1,250 @@
+/*
+ * Scores corpus files with a fixed model snapshot, on all cores.
+ *
+ * Usage: ./bdap_score <snapshot> <corpus>... [--output <file>]
+ *                     [--threads <n>] [--chunk-kb <n>] [--check]
+ *
+ * The corpus files (in the `EMAIL> ` format of `read_emails`) are memory
+ * mapped and cut into chunks of about `--chunk-kb` KiB [4096], each ending
+ * at the end of an email. Worker threads [one per core] take the chunks in
+ * order, and parse and score them with a `MappedModel`; the main thread
+ * writes the results in input order, one line `<probability> <label>` per
+ * email (label 1 for spam, 0 for ham), to the output file [stdout]. The end
+ * to end throughput is reported on stderr.
+ *
+ * The output does not depend on the chunk size: `--check` also scores every
+ * file as a single chunk afterwards, and fails (status 5) if the results
+ * differ.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "email.hpp"
+#include "mapped_model.hpp"
+#include "thread_pool.hpp"
+
+using namespace bdap;
+
+/**
+ * Whether `parse_emails` has an empty body buffer at `cut`, the start of a
+ * line after an empty line, so that text before and after `cut` parse the
+ * same apart as together. The parser appends any text after the blank line
+ * that ends an email to the body of the next one, so this holds only if the
+ * last non-empty line before `cut` is part of an email, i.e., if it or a
+ * line of its paragraph is an `EMAIL> ` header.
+ */
+static bool is_email_boundary(std::string_view text, size_t cut) {
+    size_t end = cut - 1; // the newline of the empty line before `cut`
+    while (end > 0 && text[end - 1] == '\n')
+        --end;
+    while (end > 0) { // `text[end]` ends a line, `text[begin, end)`
+        size_t begin = text.rfind('\n', end - 1);
+        begin = begin == std::string_view::npos ? 0 : begin + 1;
+        std::string_view line = text.substr(begin, end - begin);
+        if (line.empty())
+            return false; // a paragraph after the end of an email
+        if (line.compare(0, 7, "EMAIL> ") == 0)
+            return true;
+        if (begin == 0)
+            return false;
+        end = begin - 1;
+    }
+    return true; // only empty lines before `cut`
+}
+
+/** Cut `text` into pieces of about `chunk_size` bytes that each end with the
+ * blank line after an email, so that every piece parses on its own and all
+ * of them parse as `text` does. */
+static void split_chunks(std::string_view text, size_t chunk_size,
+                         std::vector<std::string_view>& chunks) {
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.size();
+        if (text.size() - begin > chunk_size) {
+            size_t next = text.find("\n\nEMAIL> ", begin + chunk_size);
+            while (next != std::string_view::npos
+                    && !is_email_boundary(text, next + 2))
+                next = text.find("\n\nEMAIL> ", next + 1);
+            if (next != std::string_view::npos)
+                end = next + 2;
+        }
+        chunks.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+}
+
+/** The output lines of one chunk. */
+struct ChunkResult {
+    std::string lines;
+    size_t num_emails = 0;
+    std::exception_ptr error;
+    bool done = false;
+};
+
+static void score_chunk(const MappedModel& model, std::string_view chunk,
+                        ChunkResult& result) {
+    std::vector<Email> emails;
+    parse_emails(chunk, emails);
+    char line[64];
+    for (const Email& email : emails) {
+        double pr = model.predict(email);
+        int n = std::snprintf(line, sizeof(line), "%.9g %d\n", pr,
+                              model.classify(pr) ? 1 : 0);
+        result.lines.append(line, n);
+    }
+    result.num_emails = emails.size();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./bdap_score <snapshot> <corpus>... [--output <file>]"
+                     " [--threads <n>] [--chunk-kb <n>] [--check]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string snapshotfname{argv[1]};
+    std::vector<std::string> corpusfnames;
+    std::string outfname;
+    long num_threads = 0;
+    long chunk_kb = 4096;
+    bool check = false;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg{argv[i]};
+        if (arg.compare(0, 2, "--") != 0) {
+            corpusfnames.push_back(arg);
+        } else if (arg == "--check") {
+            check = true;
+        } else if (i+1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        } else if (arg == "--output") {
+            outfname = argv[++i];
+        } else if (arg == "--threads") {
+            num_threads = std::atol(argv[++i]);
+        } else if (arg == "--chunk-kb") {
+            chunk_kb = std::atol(argv[++i]);
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (corpusfnames.empty() || num_threads < 0 || chunk_kb <= 0) {
+        std::cerr << "Invalid arguments" << std::endl;
+        return 2;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    std::unique_ptr<const MappedModel> model;
+    std::vector<FileMapping> corpora;
+    std::vector<std::string_view> chunks;
+    size_t num_bytes = 0;
+    try {
+        model = std::make_unique<MappedModel>(snapshotfname);
+        for (const std::string& fname : corpusfnames) {
+            corpora.emplace_back(fname);
+            std::string_view text{corpora.back().data(), corpora.back().size()};
+            split_chunks(text, size_t(chunk_kb) << 10, chunks);
+            num_bytes += text.size();
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 3;
+    }
+
+    std::ofstream outfile;
+    if (!outfname.empty()) {
+        outfile.open(outfname, std::ios::binary);
+        if (!outfile.is_open()) {
+            std::cerr << "Failed to open `" << outfname << "`" << std::endl;
+            return 3;
+        }
+    }
+    std::ostream& out = outfname.empty() ? std::cout : outfile;
+
+    // Workers take the chunks in input order, so that the writer below
+    // rarely has to wait for a chunk while later ones pile up.
+    std::vector<ChunkResult> results(chunks.size());
+    std::atomic<size_t> next_chunk{0};
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    ThreadPool pool(num_threads);
+    for (size_t t = 0; t < pool.num_threads(); ++t) {
+        pool.submit([&]() {
+            for (size_t i; (i = next_chunk++) < chunks.size(); ) {
+                try {
+                    score_chunk(*model, chunks[i], results[i]);
+                } catch (...) {
+                    results[i].error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i].done = true;
+                done_cv.notify_all();
+            }
+        });
+    }
+
+    size_t num_emails = 0;
+    int status = 0;
+    std::string written; // only with `--check`
+    for (ChunkResult& result : results) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cv.wait(lock, [&]() { return result.done; });
+        }
+        if (result.error && status == 0) {
+            try {
+                std::rethrow_exception(result.error);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to score a chunk: " << e.what() << std::endl;
+            }
+            status = 4;
+        }
+        out.write(result.lines.data(), result.lines.size());
+        if (check)
+            written += result.lines;
+        num_emails += result.num_emails;
+        result.lines = std::string();
+    }
+    out.flush();
+    pool.wait();
+
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    std::cerr << "scored " << num_emails << " emails (" << num_bytes / 1e6
+              << " MB, " << chunks.size() << " chunks) on " << pool.num_threads()
+              << " threads in " << seconds << "s: " << num_bytes / seconds / 1e9
+              << " GB/s, " << num_emails / seconds << " emails/s" << std::endl;
+
+    if (check && status == 0) {
+        std::string sequential;
+        for (const FileMapping& corpus : corpora) {
+            ChunkResult result;
+            score_chunk(*model, {corpus.data(), corpus.size()}, result);
+            sequential += result.lines;
+        }
+        if (sequential != written) {
+            std::cerr << "check failed: the chunked results differ from those of"
+                         " whole files" << std::endl;
+            return 5;
+        }
+        std::cerr << "check passed: same results as whole files" << std::endl;
+    }
+    return status;
+}
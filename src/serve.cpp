@@ -0,0 +1,492 @@
+/*
+ * A long-running classification daemon. It loads a model snapshot (written
+ * with `--snapshot` by `bdap_assignment1`, or by `save`) and serves the
+ * requests of `serve_protocol.hpp` over a Unix domain socket, or over
+ * stdin/stdout if no socket is given.
+ *
+ * Usage: ./bdap_serve <snapshot> [--socket <path>] [--threads <n>]
+ *                     [--max-batch <n>] [--max-wait-us <us>]
+ *                     [--publish-every <n>] [--learning-rate <r>]
+ *                     [--cache <entries>] [--cache-staleness <updates>]
+ *                     [--near-dup <entries>] [--near-dup-similarity <s>]
+ *                     [--max-body <bytes>]
+ *
+ * Score requests of all connections are micro-batched (see `MicroBatcher`):
+ * a batch is scored as soon as it has `--max-batch` emails [64], or when its
+ * oldest email has waited `--max-wait-us` microseconds [200], by one of
+ * `--threads` scoring threads [1]. Labelled feedback is applied by a
+ * separate training thread to a `ConcurrentModel`, which publishes the
+ * updated model every `--publish-every` updates [256] and whenever the
+ * feedback queue runs empty, so scoring never waits for training. The
+ * perceptrons continue training with `--learning-rate` [0.001], which the
+ * snapshot does not store.
+ *
+ * With `--cache`, up to that many scores are kept in a `PredictionCache`, and
+ * exact duplicates of a scored body are answered by the connection thread
+ * without tokenizing or batching them, as long as the model has seen at most
+ * `--cache-staleness` feedback updates since [0]. Likewise, `--near-dup`
+ * keeps that many scored emails in a `NearDuplicateIndex`, and reuses the
+ * score of one whose estimated similarity is at least
+ * `--near-dup-similarity` [0.8].
+ *
+ * A request whose body is longer than `--max-body` bytes [8 MiB] gets an
+ * error reply before its body is read, and its connection is closed.
+ *
+ * The daemon stops at the end of stdin, or with a socket on SIGINT or
+ * SIGTERM: it stops accepting and reading, answers the requests already
+ * read, removes the socket and prints its statistics.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "any_classifier.hpp"
+#include "concurrent_model.hpp"
+#include "email.hpp"
+#include "micro_batcher.hpp"
+#include "near_duplicate.hpp"
+#include "prediction_cache.hpp"
+#include "serve_protocol.hpp"
+
+using namespace bdap;
+
+/** A client connection; closed when the last pending request is served. */
+struct Connection {
+    int in_fd;
+    int out_fd;
+    bool owns_fds;
+    std::mutex write_mutex;
+    bool broken = false; // a write failed, under `write_mutex`
+
+    Connection(int in, int out, bool owns)
+        : in_fd(in), out_fd(out), owns_fds(owns) {}
+
+    ~Connection() {
+        if (owns_fds)
+            ::close(in_fd);
+    }
+
+    /** A client that left, or stopped reading for `SEND_TIMEOUT_SECONDS`
+     * (see `accept_connection`), just loses its replies; its socket is shut
+     * down, so that its reader stops too. */
+    void write(const std::string& data) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (broken)
+            return;
+        if (!write_all(out_fd, data)) {
+            broken = true;
+            if (owns_fds)
+                ::shutdown(out_fd, SHUT_RDWR);
+        }
+    }
+};
+
+struct Pending {
+    std::shared_ptr<Connection> conn;
+    uint64_t id;
+    Email email;
+    BodyFingerprint key; // only with a prediction cache
+    MinHashSignature signature; // only with a near-duplicate index
+};
+
+struct ServeStats {
+    std::atomic<uint64_t> num_scored{0}; // not counting cache/index hits
+    std::atomic<uint64_t> num_score_batches{0};
+    std::atomic<uint64_t> num_feedback{0};
+};
+
+using Model = ConcurrentModel<AnyClf>;
+
+/** Replies of one batch, gathered per connection so that each connection
+ * gets a single write per batch. */
+class Replies {
+    std::vector<std::pair<Connection *, std::string>> replies_;
+
+public:
+    std::string& to(Connection *conn) {
+        for (auto& r : replies_)
+            if (r.first == conn)
+                return r.second;
+        replies_.emplace_back(conn, std::string());
+        return replies_.back().second;
+    }
+
+    void send() {
+        for (auto& r : replies_)
+            r.first->write(r.second);
+        replies_.clear();
+    }
+};
+
+static void append_score(std::string& out, uint64_t id, double pr, bool label) {
+    char line[64];
+    std::snprintf(line, sizeof(line), "%llu %.9g %d\n",
+                  static_cast<unsigned long long>(id), pr, label ? 1 : 0);
+    out += line;
+}
+
+static void score_loop(const Model& model, PredictionCache *cache,
+                       NearDuplicateIndex *near_dups,
+                       MicroBatcher<Pending>& queue, ServeStats& stats) {
+    std::vector<Pending> batch;
+    Replies replies;
+    while (queue.pop_batch(batch)) {
+        if (batch.empty())
+            continue;
+        {
+            uint64_t version = model.version(); // at most that of the snapshot
+            Model::Reader clf(model); // one snapshot for the whole batch
+            for (const Pending& p : batch) {
+                double pr = clf->predict(p.email);
+                if (cache)
+                    cache->insert(p.key, version, pr);
+                if (near_dups)
+                    near_dups->insert(p.signature, version, pr);
+                append_score(replies.to(p.conn.get()), p.id, pr, clf->classify(pr));
+            }
+        }
+        replies.send();
+        stats.num_scored += batch.size();
+        ++stats.num_score_batches;
+    }
+}
+
+static void train_loop(Model& model, MicroBatcher<Pending>& queue,
+                       ServeStats& stats) {
+    std::vector<Pending> batch;
+    Replies replies;
+    while (queue.pop_batch(batch)) {
+        for (const Pending& p : batch) {
+            model.update(p.email);
+            replies.to(p.conn.get()) += std::to_string(p.id) + " ok\n";
+        }
+        if (queue.size() == 0)
+            model.publish();
+        replies.send();
+        stats.num_feedback += batch.size();
+    }
+    model.publish();
+}
+
+static void reply_cached(Connection& conn, const Model& model, uint64_t id,
+                         double pr) {
+    std::string reply;
+    append_score(reply, id, pr, Model::Reader(model)->classify(pr));
+    conn.write(reply);
+}
+
+/** Read the requests of one connection until it closes. Duplicates of
+ * recently scored emails are answered from the cache right away, without
+ * tokenizing them, and near duplicates from the near-duplicate index. */
+static void serve_connection(std::shared_ptr<Connection> conn,
+                             const Model& model, PredictionCache *cache,
+                             NearDuplicateIndex *near_dups,
+                             MicroBatcher<Pending>& scores,
+                             MicroBatcher<Pending>& feedback, uint64_t max_body) {
+    static const std::string UNLABELLED = "EMAIL> label=0";
+    static const std::string SPAM = "EMAIL> label=1";
+    static const std::string HAM = "EMAIL> label=0";
+
+    FdReader in(conn->in_fd);
+    Request req;
+    try {
+        while (read_request(in, req, max_body)) {
+            if (req.op != 'P') {
+                feedback.push({conn, req.id,
+                               Email(req.op == 'S' ? SPAM : HAM, req.body), {}, {}});
+                continue;
+            }
+            uint64_t version = model.version(); // before the reader's
+            double pr;
+            BodyFingerprint key;
+            if (cache) {
+                key = BodyFingerprint::of(req.body);
+                if (cache->find(key, version, pr)) {
+                    reply_cached(*conn, model, req.id, pr);
+                    continue;
+                }
+            }
+            Email email(UNLABELLED, req.body);
+            MinHashSignature signature;
+            if (near_dups) {
+                near_dups->signature(email, signature);
+                if (near_dups->find(signature, version, pr)) {
+                    reply_cached(*conn, model, req.id, pr);
+                    continue;
+                }
+            }
+            scores.push({conn, req.id, std::move(email), key, std::move(signature)});
+        }
+    } catch (const std::runtime_error& e) {
+        conn->write(std::to_string(req.id) + " error " + e.what() + "\n");
+    }
+}
+
+/** Writes to a socket client block at most this long. */
+constexpr long SEND_TIMEOUT_SECONDS = 10;
+
+/** A connection from `accept`, with a bounded blocking time for writes, so
+ * that neither its reader (with cached and error replies) nor the scoring
+ * and training threads can hang on a client that stops reading. */
+static std::shared_ptr<Connection> accept_connection(int fd) {
+    timeval timeout{};
+    timeout.tv_sec = SEND_TIMEOUT_SECONDS;
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return std::make_shared<Connection>(fd, fd, true);
+}
+
+/** The socket connections being read, so that shutdown can stop reading
+ * them and wait for their threads. */
+class LiveConnections {
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<int> fds_;
+
+public:
+    void add(int fd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fds_.push_back(fd);
+    }
+
+    /** Called by a connection's thread when it stops reading `fd`. */
+    void remove(int fd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fds_.erase(std::find(fds_.begin(), fds_.end(), fd));
+        cv_.notify_all();
+    }
+
+    /** End the input of every connection, and wait until all threads have
+     * stopped reading. Their pending requests are still answered. A thread
+     * blocked in a reply to a client that does not read returns after the
+     * send timeout of `accept_connection`. */
+    void shutdown() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (int fd : fds_)
+            ::shutdown(fd, SHUT_RD);
+        cv_.wait(lock, [this]() { return fds_.empty(); });
+    }
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+static int signal_listen_fd = -1;
+
+/** SIGINT/SIGTERM: stop the accept loop. */
+static void request_stop(int) {
+    stop_requested = 1;
+    ::shutdown(signal_listen_fd, SHUT_RDWR); // wakes up `accept`
+}
+
+static int listen_unix(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path too long");
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("failed to create socket");
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+            || ::listen(fd, 128) != 0) {
+        ::close(fd);
+        throw std::runtime_error("failed to listen on `" + path + "`");
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: ./bdap_serve <snapshot> [--socket <path>]"
+                     " [--threads <n>] [--max-batch <n>] [--max-wait-us <us>]"
+                     " [--publish-every <n>] [--learning-rate <r>]"
+                     " [--cache <entries>] [--cache-staleness <updates>]"
+                     " [--near-dup <entries>] [--near-dup-similarity <s>]"
+                     " [--max-body <bytes>]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string snapshotfname{argv[1]};
+    std::string socketpath;
+    int num_threads = 1;
+    long max_batch = 64;
+    long max_wait_us = 200;
+    long publish_every = 256;
+    double learning_rate = 0.001;
+    long cache_entries = 0;
+    long cache_staleness = 0;
+    long near_dup_entries = 0;
+    double near_dup_similarity = NearDuplicateConfig{}.min_similarity;
+    long long max_body = DEFAULT_MAX_BODY;
+
+    for (int i = 2; i < argc; i += 2) {
+        std::string opt{argv[i]};
+        if (i+1 >= argc) {
+            std::cerr << "Missing value for " << opt << std::endl;
+            return 1;
+        } else if (opt == "--socket") {
+            socketpath = argv[i+1];
+        } else if (opt == "--threads") {
+            num_threads = std::atoi(argv[i+1]);
+        } else if (opt == "--max-batch") {
+            max_batch = std::atol(argv[i+1]);
+        } else if (opt == "--max-wait-us") {
+            max_wait_us = std::atol(argv[i+1]);
+        } else if (opt == "--publish-every") {
+            publish_every = std::atol(argv[i+1]);
+        } else if (opt == "--learning-rate") {
+            learning_rate = std::atof(argv[i+1]);
+        } else if (opt == "--cache") {
+            cache_entries = std::atol(argv[i+1]);
+        } else if (opt == "--cache-staleness") {
+            cache_staleness = std::atol(argv[i+1]);
+        } else if (opt == "--near-dup") {
+            near_dup_entries = std::atol(argv[i+1]);
+        } else if (opt == "--near-dup-similarity") {
+            near_dup_similarity = std::atof(argv[i+1]);
+        } else if (opt == "--max-body") {
+            max_body = std::atoll(argv[i+1]);
+        } else {
+            std::cerr << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    if (num_threads <= 0 || max_batch <= 0 || max_wait_us < 0
+            || publish_every <= 0 || cache_entries < 0 || cache_staleness < 0
+            || near_dup_entries < 0 || near_dup_similarity <= 0.0
+            || near_dup_similarity > 1.0 || max_body <= 0) {
+        std::cerr << "Invalid batching options" << std::endl;
+        return 2;
+    }
+
+    std::ifstream snapshotfile{snapshotfname, std::ios::binary};
+    if (!snapshotfile.is_open()) {
+        std::cerr << "Failed to open `" << snapshotfname << "`" << std::endl;
+        return 3;
+    }
+    std::unique_ptr<Model> model;
+    try {
+        model = std::make_unique<Model>(AnyClf::load(snapshotfile, learning_rate),
+                                        publish_every);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to load `" << snapshotfname << "`: " << e.what()
+                  << std::endl;
+        return 3;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN); // writes to closed connections just fail
+
+    auto max_wait = std::chrono::microseconds(max_wait_us);
+    MicroBatcher<Pending> scores(max_batch, max_wait);
+    MicroBatcher<Pending> feedback(max_batch, max_wait);
+    ServeStats stats;
+    std::unique_ptr<PredictionCache> cache;
+    if (cache_entries > 0)
+        cache = std::make_unique<PredictionCache>(cache_entries, 16, cache_staleness);
+    std::unique_ptr<NearDuplicateIndex> near_dups;
+    if (near_dup_entries > 0) {
+        NearDuplicateConfig config;
+        config.min_similarity = near_dup_similarity;
+        near_dups = std::make_unique<NearDuplicateIndex>(near_dup_entries, config,
+                                                         cache_staleness);
+    }
+
+    std::vector<std::thread> workers;
+    LiveConnections live; // only with a socket
+    for (int i = 0; i < num_threads; ++i)
+        workers.emplace_back([&]() {
+            score_loop(*model, cache.get(), near_dups.get(), scores, stats);
+        });
+    workers.emplace_back([&]() { train_loop(*model, feedback, stats); });
+
+    if (socketpath.empty()) {
+        serve_connection(std::make_shared<Connection>(0, 1, false), *model,
+                         cache.get(), near_dups.get(), scores, feedback, max_body);
+    } else {
+        int listen_fd;
+        try {
+            listen_fd = listen_unix(socketpath);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            std::exit(4);
+        }
+        signal_listen_fd = listen_fd;
+        struct sigaction action = {};
+        action.sa_handler = request_stop; // no SA_RESTART: `accept` fails
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGINT, &action, nullptr);
+        ::sigaction(SIGTERM, &action, nullptr);
+
+        std::cerr << "listening on " << socketpath << std::endl;
+        while (!stop_requested) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED || stop_requested)
+                    continue;
+                // e.g., out of file descriptors: retrying right away would
+                // spin until some connection closes
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            live.add(fd);
+            auto conn = accept_connection(fd);
+            std::thread([conn, &live, &model, &cache, &near_dups, &scores,
+                         &feedback, max_body]() {
+                serve_connection(conn, *model, cache.get(), near_dups.get(),
+                                 scores, feedback, max_body);
+                live.remove(conn->in_fd);
+            }).detach();
+        }
+        ::close(listen_fd);
+        ::unlink(socketpath.c_str());
+        std::cerr << "shutting down" << std::endl;
+        live.shutdown();
+    }
+
+    scores.close();
+    feedback.close();
+    for (auto& t : workers)
+        t.join();
+
+    uint64_t num_batches = stats.num_score_batches;
+    std::cerr << "scored " << stats.num_scored << " emails in " << num_batches
+              << " batches ("
+              << (num_batches ? double(stats.num_scored) / num_batches : 0.0)
+              << " per batch), " << stats.num_feedback << " feedback updates, "
+              << model->num_publishes() << " publishes" << std::endl;
+    if (cache) {
+        PredictionCache::Stats cs = cache->stats();
+        std::cerr << "cache: " << cs.hits << " hits, " << cs.misses << " misses ("
+                  << cs.stale << " stale), hit rate " << cs.hit_rate() << std::endl;
+    }
+    if (near_dups) {
+        NearDuplicateIndex::Stats ns = near_dups->stats();
+        std::cerr << "near duplicates: " << ns.hits << " hits, " << ns.misses
+                  << " misses, " << ns.candidates << " candidates compared, hit rate "
+                  << ns.hit_rate() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace bdap {
+
+/**
+ * The framed text protocol of `bdap_serve`, over a Unix domain socket or
+ * stdin/stdout.
+ *
+ * A request is a header line followed by exactly `<length>` bytes of email
+ * body (which may contain newlines):
+ *
+ *     P <id> <length>\n<body>    score the email
+ *     S <id> <length>\n<body>    feedback: the email is spam
+ *     H <id> <length>\n<body>    feedback: the email is ham
+ *
+ * `<id>` is chosen by the client and echoed in its reply. Replies are single
+ * lines:
+ *
+ *     <id> <probability> <label>\n    for P, label 1 for spam and 0 for ham
+ *     <id> ok\n                       for S and H, once the model was updated
+ *     <id> error <message>\n          for a malformed request, after which
+ *                                     the connection is closed
+ *
+ * `<id>` and `<length>` are unsigned decimal numbers. A body longer than the
+ * server's limit is refused before it is read.
+ *
+ * Scores and feedback are served by different threads, so clients must match
+ * replies to requests by id rather than by order.
+ */
+struct Request {
+    char op = 'P';
+    uint64_t id = 0;
+    std::string body;
+};
+
+/** Buffered reads from a file descriptor. */
+class FdReader {
+    int fd_;
+    std::vector<char> buf_;
+    size_t begin_ = 0, end_ = 0;
+
+public:
+    explicit FdReader(int fd, size_t buffer_size = 1 << 16)
+        : fd_(fd), buf_(buffer_size) {}
+
+    /** The next line without its newline; false at the end of the input. */
+    bool read_line(std::string& line) {
+        line.clear();
+        for (;;) {
+            for (size_t i = begin_; i < end_; ++i) {
+                if (buf_[i] == '\n') {
+                    line.append(&buf_[begin_], i - begin_);
+                    begin_ = i + 1;
+                    return true;
+                }
+            }
+            line.append(&buf_[begin_], end_ - begin_);
+            begin_ = end_;
+            if (!fill())
+                return false;
+        }
+    }
+
+    /** Exactly `n` bytes; false if the input ends first. */
+    bool read_exact(std::string& out, size_t n) {
+        out.clear();
+        while (out.size() < n) {
+            if (begin_ == end_ && !fill())
+                return false;
+            size_t k = std::min(n - out.size(), end_ - begin_);
+            out.append(&buf_[begin_], k);
+            begin_ += k;
+        }
+        return true;
+    }
+
+private:
+    bool fill() {
+        for (;;) {
+            ssize_t k = ::read(fd_, buf_.data(), buf_.size());
+            if (k < 0 && errno == EINTR)
+                continue;
+            begin_ = 0;
+            end_ = k > 0 ? static_cast<size_t>(k) : 0;
+            return k > 0;
+        }
+    }
+};
+
+/** Write all of `data`; false if the other end is gone. */
+inline bool write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t k = ::write(fd, data.data() + done, data.size() - done);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return false;
+        done += static_cast<size_t>(k);
+    }
+    return true;
+}
+
+/** `s` as an unsigned decimal number; false if it is not one (a sign, say)
+ * or does not fit in 64 bits. */
+inline bool parse_decimal(const std::string& s, uint64_t& value) {
+    if (s.empty() || s.size() > 19) // 19 digits always fit
+        return false;
+    value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+/** Default limit on the length of a request body, in bytes. */
+constexpr uint64_t DEFAULT_MAX_BODY = uint64_t(8) << 20;
+
+/** The next request; false at the end of the input. Throws
+ * `std::runtime_error` on a malformed header, or on a body longer than
+ * `max_body` bytes, which is then not read. */
+inline bool read_request(FdReader& in, Request& req,
+                         uint64_t max_body = DEFAULT_MAX_BODY) {
+    std::string line;
+    if (!in.read_line(line))
+        return false;
+    req.id = 0;
+    std::istringstream ss(line);
+    std::string id, length_str;
+    uint64_t length = 0;
+    if (!(ss >> req.op >> id >> length_str) || !parse_decimal(id, req.id)
+            || !parse_decimal(length_str, length)
+            || (req.op != 'P' && req.op != 'S' && req.op != 'H'))
+        throw std::runtime_error("malformed request `" + line + "`");
+    if (length > max_body)
+        throw std::runtime_error("request body of " + length_str
+                                 + " bytes exceeds the limit of "
+                                 + std::to_string(max_body));
+    if (!in.read_exact(req.body, length))
+        throw std::runtime_error("truncated request body");
+    return true;
+}
+
+inline void append_request(std::string& out, char op, uint64_t id,
+                           const std::string& body) {
+    out += op;
+    out += ' ';
+    out += std::to_string(id);
+    out += ' ';
+    out += std::to_string(body.size());
+    out += '\n';
+    out += body;
+}
+
+} // namespace bdap
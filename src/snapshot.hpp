@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "hash_policy.hpp"
+
+namespace bdap {
+
+/**
+ * On-disk model snapshot.
+ *
+ * A snapshot is a fixed-size header followed by the raw parameter table(s) of
+ * a classifier, laid out contiguously so that a reader can `mmap` the file and
+ * score straight from the mapped pages (see `MappedModel`). The table starts
+ * at `table_offset`, which is a multiple of `SNAPSHOT_ALIGN`, so that the ints
+ * and doubles in the table are naturally aligned in the mapping.
+ *
+ * Table layouts (row-major, one row per hash function):
+ *  - NaiveBayesFeatureHashing:  int32 [2 * 2^log_num_buckets]
+ *  - NaiveBayesCountMin:        int32 [num_hashes][2 * 2^log_num_buckets]
+ *  - PerceptronFeatureHashing:  double[2^log_num_buckets]
+ *  - PerceptronCountMin:        double[num_hashes][2^log_num_buckets]
+ *  - SparseFeatureHashing:      SparseEntry[num_entries], by bucket
+ */
+enum class ModelKind : uint32_t {
+    NaiveBayesFeatureHashing = 1,
+    NaiveBayesCountMin = 2,
+    PerceptronFeatureHashing = 3,
+    PerceptronCountMin = 4,
+    SparseFeatureHashing = 5,
+};
+
+/** A non-zero weight of a sparse model. */
+struct SparseEntry {
+    uint64_t bucket;
+    double weight;
+};
+
+constexpr char SNAPSHOT_MAGIC[8] = {'B', 'D', 'A', 'P', 'S', 'N', 'P', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint64_t SNAPSHOT_ALIGN = 128;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    ModelKind kind;
+    int32_t ngram;
+    int32_t num_hashes;
+    int32_t log_num_buckets;
+    int32_t seed; // hash seed of the feature hashing models, 0 otherwise
+    double threshold;
+    // Naive Bayes statistics (zero for the perceptrons)
+    double n_spam;
+    double n_ham;
+    double n_spam_grams;
+    double n_ham_grams;
+    uint64_t table_offset; // in bytes, from the start of the file
+    uint64_t table_bytes;
+    uint64_t num_entries; // sparse models only
+    HashKind hash_function; // of the n-grams; 0 (Murmur3) in older snapshots
+
+    size_t num_buckets() const { return size_t(1) << log_num_buckets; }
+
+    /** Size in bytes of a single row of the table. */
+    size_t row_bytes() const {
+        switch (kind) {
+        case ModelKind::NaiveBayesFeatureHashing:
+        case ModelKind::NaiveBayesCountMin:
+            return 2 * num_buckets() * sizeof(int32_t);
+        case ModelKind::PerceptronFeatureHashing:
+        case ModelKind::PerceptronCountMin:
+            return num_buckets() * sizeof(double);
+        case ModelKind::SparseFeatureHashing:
+            return num_entries * sizeof(SparseEntry);
+        }
+        throw std::runtime_error("invalid snapshot model kind");
+    }
+
+    /** Throws if the header is not a well-formed snapshot header for a file
+     * of `file_size` bytes. */
+    void validate(uint64_t file_size) const {
+        if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+            throw std::runtime_error("not a model snapshot");
+        if (version != SNAPSHOT_VERSION)
+            throw std::runtime_error("unsupported model snapshot version");
+        if (ngram <= 0 || num_hashes <= 0 || log_num_buckets < 0
+                || log_num_buckets > 40)
+            throw std::runtime_error("invalid model snapshot parameters");
+        if (kind == ModelKind::SparseFeatureHashing
+                && (num_hashes != 1 || num_entries > file_size / sizeof(SparseEntry)))
+            throw std::runtime_error("invalid sparse model snapshot");
+        if (static_cast<uint32_t>(hash_function) > static_cast<uint32_t>(HashKind::WyHash))
+            throw std::runtime_error("invalid model snapshot hash function");
+        if (table_bytes != row_bytes() * num_hashes
+                || table_offset % SNAPSHOT_ALIGN != 0
+                || table_offset + table_bytes > file_size)
+            throw std::runtime_error("truncated model snapshot");
+    }
+
+    /** Throws unless the n-grams were hashed with `hash` (the `hash_kind` of
+     * the classifier that reads the snapshot). */
+    void check_hash(HashKind hash) const {
+        if (hash_function != hash)
+            throw std::runtime_error("model snapshot hashed with another hash function");
+    }
+};
+
+static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_ALIGN,
+              "snapshot header must fit before the first table row");
+
+inline SnapshotHeader make_snapshot_header(ModelKind kind, HashKind hash_function,
+                                           int ngram, int num_hashes,
+                                           int log_num_buckets, int seed,
+                                           double threshold) {
+    SnapshotHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.kind = kind;
+    h.ngram = ngram;
+    h.num_hashes = num_hashes;
+    h.log_num_buckets = log_num_buckets;
+    h.seed = seed;
+    h.hash_function = hash_function;
+    h.threshold = threshold;
+    h.table_offset = SNAPSHOT_ALIGN;
+    h.table_bytes = h.row_bytes() * num_hashes;
+    return h;
+}
+
+/** Write the header, padding, and the rows of the table to `os`. */
+template <typename T>
+void write_snapshot(std::ostream& os, const SnapshotHeader& header,
+                    const std::vector<const std::vector<T> *>& rows) {
+    char pad[SNAPSHOT_ALIGN] = {0};
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.write(pad, header.table_offset - sizeof(header));
+    for (const std::vector<T> *row : rows) {
+        if (row->size() * sizeof(T) != header.row_bytes())
+            throw std::logic_error("snapshot row size mismatch");
+        os.write(reinterpret_cast<const char *>(row->data()),
+                 row->size() * sizeof(T));
+    }
+    if (!os)
+        throw std::runtime_error("failed to write model snapshot");
+}
+
+/** Read and check the header of a snapshot, up to the padding before the
+ * table. */
+inline SnapshotHeader read_snapshot_header(std::istream& is) {
+    SnapshotHeader header;
+    is.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!is)
+        throw std::runtime_error("truncated model snapshot");
+    header.validate(header.table_offset + header.table_bytes);
+    return header;
+}
+
+/** Read the rows of the table after `read_snapshot_header` into `rows`,
+ * which must already have the right sizes, for a classifier of kind `kind`
+ * that hashes with `hash`. */
+template <typename T>
+void read_snapshot(std::istream& is, const SnapshotHeader& header,
+                   ModelKind kind, HashKind hash,
+                   const std::vector<std::vector<T> *>& rows) {
+    if (header.kind != kind)
+        throw std::runtime_error("model snapshot of another classifier");
+    header.check_hash(hash);
+    is.ignore(header.table_offset - sizeof(header));
+    for (std::vector<T> *row : rows) {
+        if (row->size() * sizeof(T) != header.row_bytes())
+            throw std::logic_error("snapshot row size mismatch");
+        is.read(reinterpret_cast<char *>(row->data()), row->size() * sizeof(T));
+    }
+    if (!is)
+        throw std::runtime_error("truncated model snapshot");
+}
+
+} // namespace bdap
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "email.hpp"
+#include "base_classifier.hpp"
+#include "snapshot.hpp"
+
+namespace bdap {
+
+/** The logistic function; the score of the FTRL models. */
+inline double sigmoid(double a) { return 1.0 / (1.0 + std::exp(-a)); }
+
+/**
+ * A read-only logistic model over the hashed n-grams of
+ * `PerceptronFeatureHashing` that stores only its non-zero weights, as
+ * exported by `FtrlFeatureHashing::export_sparse`.
+ *
+ * The weights are kept in a cuckoo hash table: every bucket is in one of two
+ * slots, so a lookup is two loads and two selects, without branches on
+ * whether the n-gram has a weight (which is hard to predict). A model of a
+ * few thousand weights fits in the L2 cache, whatever the number of hash
+ * buckets it was trained with. An n-gram whose bucket is not in the table has
+ * weight zero. Predictions are identical to those of the model that exported
+ * it.
+ */
+class SparseModel : public BaseClf<SparseModel> {
+    struct Slot {
+        uint32_t key; // bucket + 1, 0 if empty
+        double weight;
+    };
+
+    int ngram_;
+    int log_num_buckets_;
+    int seed_;
+    std::vector<Slot> slots_;
+    int shift_;
+    size_t num_entries_ = 0;
+
+public:
+    SparseModel(int ngram, int log_num_buckets, int seed,
+                const std::vector<SparseEntry>& entries)
+        : BaseClf(0.5)
+        , ngram_(ngram)
+        , log_num_buckets_(log_num_buckets)
+        , seed_(seed)
+    {
+        if (log_num_buckets < 0 || log_num_buckets > 31)
+            throw std::invalid_argument("sparse model needs log_num_buckets <= 31");
+        int log_capacity = 1;
+        while ((size_t(1) << log_capacity) < 2 * entries.size())
+            ++log_capacity;
+        while (!build(log_capacity, entries))
+            ++log_capacity;
+    }
+
+    int ngram() const { return ngram_; }
+    int log_num_buckets() const { return log_num_buckets_; }
+    size_t num_entries() const { return num_entries_; }
+
+    /** Size of the weight table in bytes. */
+    size_t memory_bytes() const { return slots_.capacity() * sizeof(Slot); }
+
+    void update_(const Email&) {
+        throw std::logic_error("SparseModel is read-only");
+    }
+
+    template <typename E>
+    double predict_(const E& email) const {
+        auto allngrams = ngrams_of(email, ngram_);
+        double a = 0.0;
+        while (allngrams) {
+            allngrams.next();
+            a += weight(allngrams.hash(seed_) & ((size_t(1) << log_num_buckets_) - 1));
+        }
+        return sigmoid(a);
+    }
+
+    /** The weight of `bucket`, zero if it has none. */
+    double weight(size_t bucket) const {
+        uint32_t key = static_cast<uint32_t>(bucket) + 1;
+        const Slot& s1 = slots_[slot1(key)];
+        const Slot& s2 = slots_[slot2(key)];
+        return masked(s1.weight, s1.key == key) + masked(s2.weight, s2.key == key);
+    }
+
+    /** The non-zero weights, by bucket. */
+    std::vector<SparseEntry> entries() const {
+        std::vector<SparseEntry> entries;
+        entries.reserve(num_entries_);
+        for (const Slot& s : slots_)
+            if (s.key != 0)
+                entries.push_back({uint64_t(s.key) - 1, s.weight});
+        std::sort(entries.begin(), entries.end(),
+                  [](const SparseEntry& a, const SparseEntry& b) {
+                      return a.bucket < b.bucket; });
+        return entries;
+    }
+
+    /** Write the model as a snapshot, which `MappedModel` can also map. */
+    void save(std::ostream& os) const {
+        std::vector<SparseEntry> rows = entries();
+        SnapshotHeader header = make_snapshot_header(
+                ModelKind::SparseFeatureHashing, hash_kind, ngram_, 1,
+                log_num_buckets_, seed_, threshold());
+        header.num_entries = rows.size();
+        header.table_bytes = header.row_bytes();
+        write_snapshot<SparseEntry>(os, header, {&rows});
+    }
+
+    /** Read a model written by `save`. The header was already read with
+     * `read_snapshot_header`. */
+    static SparseModel load(const SnapshotHeader& header, std::istream& is) {
+        std::vector<SparseEntry> rows(header.num_entries);
+        read_snapshot<SparseEntry>(is, header, ModelKind::SparseFeatureHashing,
+                                   hash_kind, {&rows});
+        return SparseModel(header.ngram, header.log_num_buckets, header.seed,
+                           rows);
+    }
+
+private:
+    /** `keep ? w : 0.0`, without a branch (compilers branch on the select). */
+    static double masked(double w, bool keep) {
+        uint64_t bits;
+        std::memcpy(&bits, &w, sizeof(bits));
+        bits &= -static_cast<uint64_t>(keep);
+        std::memcpy(&w, &bits, sizeof(w));
+        return w;
+    }
+
+    size_t slot1(uint32_t key) const
+    { return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> shift_); }
+
+    /** Never `slot1(key)`, so that `weight` counts a key once. */
+    size_t slot2(uint32_t key) const {
+        size_t offset = static_cast<size_t>((key * 0xc2b2ae3d27d4eb4full) >> shift_);
+        return slot1(key) ^ (offset | 1);
+    }
+
+    /** Fill a table of `2^log_capacity` slots; false if the cuckoo insertion
+     * fails and a larger table is needed. */
+    bool build(int log_capacity, const std::vector<SparseEntry>& entries) {
+        slots_.assign(size_t(1) << log_capacity, Slot{0, 0.0});
+        shift_ = 64 - log_capacity;
+        num_entries_ = 0;
+        for (const SparseEntry& e : entries)
+            if (e.weight != 0.0 && !insert(static_cast<uint32_t>(e.bucket) + 1, e.weight))
+                return false;
+        return true;
+    }
+
+    bool insert(uint32_t key, double weight) {
+        for (size_t i : {slot1(key), slot2(key)}) {
+            if (slots_[i].key == key) {
+                slots_[i].weight = weight;
+                return true;
+            }
+        }
+        ++num_entries_;
+        Slot slot{key, weight};
+        size_t i = slot1(key);
+        for (int kicks = 0; kicks < 64; ++kicks) {
+            if (slots_[i].key == 0) {
+                slots_[i] = slot;
+                return true;
+            }
+            std::swap(slot, slots_[i]); // evict to its other slot
+            i = i == slot1(slot.key) ? slot2(slot.key) : slot1(slot.key);
+        }
+        return false;
+    }
+};
+
+} // namespace bdap
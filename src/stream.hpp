@@ -0,0 +1,236 @@
+#pragma once
+
+#include <chrono>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "alloc_tracker.hpp"
+#include "email.hpp"
+#include "perf_counters.hpp"
+#include "profile.hpp"
+
+namespace bdap {
+
+/** Metrics that derive several scores from one evaluation implement
+ * `get_scores()` (and `score_names()`), see `ConfusionMatrix`. */
+template <typename Metric, typename = void>
+struct has_scores : std::false_type {};
+
+template <typename Metric>
+struct has_scores<Metric, std::void_t<
+    decltype(std::declval<const Metric&>().get_scores())>> : std::true_type {};
+
+/** Throughput of a single window of `stream_emails`. */
+struct WindowStats {
+    size_t num_emails = 0;
+    size_t num_ngrams = 0; // n-grams per email, summed over the window
+    double seconds = 0.0;  // wall time of the evaluation and the updates
+    std::vector<double> scores; // all scores of a multi-score metric
+    PhaseStats phases;     // only filled in with BDAP_PROFILE
+    PerfCounts predict_perf; // only filled in with BDAP_PERF_COUNTERS
+    PerfCounts update_perf;
+    AllocStats predict_allocs; // only filled in with BDAP_TRACK_ALLOCS
+    AllocStats update_allocs;
+
+    double emails_per_sec() const { return num_emails / seconds; }
+    double ngrams_per_sec() const { return num_ngrams / seconds; }
+    double ns_per_ngram() const { return seconds * 1e9 / num_ngrams; }
+};
+
+/**
+ * This function emulates a stream of emails. Every `window` examples, the
+ * metric is evaluated and the score is recorded. Use the results of this
+ * function to plot your learning curves.
+ *
+ * The throughput of each window is appended to `stats`.
+ */
+template <typename Clf, typename Metric>
+std::vector<double>
+stream_emails(const std::vector<Email> &emails,
+              Clf& clf, Metric& metric, int window,
+              std::vector<WindowStats>& stats) {
+    using clock = std::chrono::steady_clock;
+#if BDAP_PERF_COUNTERS
+    PerfCounters perf;
+#endif
+
+    std::vector<double> metric_values;
+    for (size_t i = 0; i < emails.size(); i+=window) {
+        WindowStats ws;
+        PhaseStats phases_begin = phase_stats();
+        clock::time_point begin = clock::now();
+
+#if BDAP_TRACK_ALLOCS
+        AllocStats allocs_begin = thread_alloc_stats();
+#endif
+#if BDAP_PERF_COUNTERS
+        perf.start();
+#endif
+        for (size_t u = 0; u < window && i+u < emails.size(); ++u) {
+            BDAP_PROFILE_SCOPE(Phase::Metric, 0);
+            metric.evaluate(clf, emails[i+u]);
+        }
+#if BDAP_PERF_COUNTERS
+        ws.predict_perf = perf.stop();
+#endif
+#if BDAP_TRACK_ALLOCS
+        ws.predict_allocs = thread_alloc_stats();
+        ws.predict_allocs -= allocs_begin;
+#endif
+
+        double score = metric.get_score();
+        metric_values.push_back(score);
+        if constexpr (has_scores<Metric>::value)
+            ws.scores = metric.get_scores();
+
+#if BDAP_TRACK_ALLOCS
+        allocs_begin = thread_alloc_stats();
+#endif
+#if BDAP_PERF_COUNTERS
+        perf.start();
+#endif
+        for (size_t u = 0; u < window && i+u < emails.size(); ++u)
+            clf.update(emails[i+u]);
+#if BDAP_PERF_COUNTERS
+        ws.update_perf = perf.stop();
+#endif
+#if BDAP_TRACK_ALLOCS
+        ws.update_allocs = thread_alloc_stats();
+        ws.update_allocs -= allocs_begin;
+#endif
+
+        clock::time_point end = clock::now();
+        ws.seconds = std::chrono::duration<double>(end - begin).count();
+        ws.phases = phase_stats();
+        ws.phases -= phases_begin;
+        for (size_t u = 0; u < window && i+u < emails.size(); ++u) {
+            ++ws.num_emails;
+            ws.num_ngrams += EmailIter(emails[i+u], clf.ngram()).size();
+        }
+        stats.push_back(ws);
+    }
+    return metric_values;
+}
+
+template <typename Clf, typename Metric>
+std::vector<double>
+stream_emails(const std::vector<Email> &emails,
+              Clf& clf, Metric& metric, int window) {
+    std::vector<WindowStats> stats;
+    return stream_emails(emails, clf, metric, window, stats);
+}
+
+/**
+ * Write the learning curve to a results file: `key=value` properties,
+ * followed by one line per window with the metric value and the throughput
+ * of that window (and the per-phase times with BDAP_PROFILE, and the
+ * hardware counters with BDAP_PERF_COUNTERS, `nan` if unavailable). For a
+ * multi-score metric, pass its `score_names()` to also write all scores.
+ */
+inline void write_results(std::ostream& os, int window, int ngram,
+                          size_t num_emails,
+                          const std::vector<double>& metric_values,
+                          const std::vector<WindowStats>& stats,
+                          const std::vector<std::string>& score_names = {}) {
+    os << "window=" << window << std::endl;
+    os << "ngram=" << ngram << std::endl;
+    os << "#emails=" << num_emails << std::endl;
+    os << "columns=metric emails_per_sec ngrams_per_sec ns_per_ngram";
+    for (const std::string& name : score_names)
+        os << ' ' << name;
+#if BDAP_PROFILE
+    for (int p = 0; p < NUM_PHASES; ++p)
+        os << ' ' << phase_name(static_cast<Phase>(p)) << "_ns";
+#endif
+#if BDAP_PERF_COUNTERS
+    for (const char *phase : {"predict", "update"})
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+            os << ' ' << phase << '_' << perf_event_name(static_cast<PerfEvent>(e))
+               << "_per_ngram";
+#endif
+#if BDAP_TRACK_ALLOCS
+    os << " predict_allocs_per_email predict_alloc_bytes_per_email"
+          " update_allocs_per_email update_alloc_bytes_per_email";
+#endif
+    os << std::endl;
+    for (size_t w = 0; w < metric_values.size(); ++w) {
+        const WindowStats& ws = stats[w];
+        os << metric_values[w]
+           << ' ' << ws.emails_per_sec()
+           << ' ' << ws.ngrams_per_sec()
+           << ' ' << ws.ns_per_ngram();
+        for (size_t k = 0; k < score_names.size(); ++k)
+            os << ' ' << (k < ws.scores.size() ? ws.scores[k] : 0.0);
+#if BDAP_PROFILE
+        for (int p = 0; p < NUM_PHASES; ++p)
+            os << ' ' << ws.phases.ns[p];
+#endif
+#if BDAP_PERF_COUNTERS
+        for (const PerfCounts *perf : {&ws.predict_perf, &ws.update_perf})
+            for (int e = 0; e < NUM_PERF_EVENTS; ++e)
+                os << ' ' << (perf->valid[e] // nan: not measured
+                              ? static_cast<double>(perf->value[e]) / ws.num_ngrams
+                              : std::numeric_limits<double>::quiet_NaN());
+#endif
+#if BDAP_TRACK_ALLOCS
+        for (const AllocStats *allocs : {&ws.predict_allocs, &ws.update_allocs})
+            os << ' ' << static_cast<double>(allocs->allocs) / ws.num_emails
+               << ' ' << static_cast<double>(allocs->bytes) / ws.num_emails;
+#endif
+        os << std::endl;
+    }
+}
+
+/** Print the hardware counters of the predict and update phases, summed over
+ * all windows, per email and per n-gram. */
+inline void print_perf_summary(std::ostream& os,
+                               const std::vector<WindowStats>& stats) {
+    PerfCounts predict, update;
+    double num_emails = 0.0, num_ngrams = 0.0;
+    for (const WindowStats& ws : stats) {
+        predict += ws.predict_perf;
+        update += ws.update_perf;
+        num_emails += ws.num_emails;
+        num_ngrams += ws.num_ngrams;
+    }
+    for (const auto& [name, counts] : {std::make_pair("predict", predict),
+                                       std::make_pair("update", update)}) {
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+            os << name << ' ' << perf_event_name(static_cast<PerfEvent>(e))
+               << ": ";
+            if (!counts.valid[e]) {
+                os << "n/a" << std::endl;
+                continue;
+            }
+            os << (counts.value[e] / num_emails) << "/email, "
+               << (counts.value[e] / num_ngrams) << "/ngram" << std::endl;
+        }
+    }
+}
+
+/** Print the allocations of the predict and update phases, summed over all
+ * windows, per email, and the heap and resident memory of the process. */
+inline void print_alloc_summary(std::ostream& os,
+                                const std::vector<WindowStats>& stats) {
+    AllocStats predict, update;
+    double num_emails = 0.0;
+    for (const WindowStats& ws : stats) {
+        predict += ws.predict_allocs;
+        update += ws.update_allocs;
+        num_emails += ws.num_emails;
+    }
+    os << "predict allocs: " << (predict.allocs / num_emails) << "/email, "
+       << (predict.bytes / num_emails) << " bytes/email" << std::endl;
+    os << "update allocs: " << (update.allocs / num_emails) << "/email, "
+       << (update.bytes / num_emails) << " bytes/email" << std::endl;
+    os << "heap: " << live_heap_bytes().load() << " bytes live, "
+       << peak_heap_bytes().load() << " bytes peak" << std::endl;
+    os << "rss: " << current_rss_bytes() << " bytes, "
+       << peak_rss_bytes() << " bytes peak" << std::endl;
+}
+
+} // namespace bdap
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bdap {
+
+/**
+ * A fixed-size pool of threads with one task deque per worker.
+ *
+ * A worker pops its own most recently pushed task (LIFO, cache friendly) and,
+ * when its deque is empty, steals the oldest task from another worker (FIFO).
+ * Tasks submitted from outside the pool are spread round-robin over the
+ * deques; tasks submitted by a running task go to that worker's own deque.
+ *
+ * The first exception thrown by a task is rethrown by `wait`.
+ */
+class ThreadPool {
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_; // guards the waits below
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::atomic<size_t> queued_{0};  // tasks in the deques
+    std::atomic<size_t> pending_{0}; // tasks submitted but not finished
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<size_t> num_steals_{0};
+    bool stop_ = false;
+    std::exception_ptr error_;
+
+public:
+    /** `num_threads == 0` uses one thread per hardware thread. */
+    explicit ThreadPool(size_t num_threads = 0) {
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < num_threads; ++i)
+            queues_.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < num_threads; ++i)
+            threads_.emplace_back([this, i]() { work(i); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (std::thread& t : threads_)
+            t.join();
+    }
+
+    size_t num_threads() const { return threads_.size(); }
+
+    /** Number of tasks that were run by another worker than they were
+     * queued on. */
+    size_t num_steals() const { return num_steals_.load(); }
+
+    void submit(Task task) {
+        int self = worker_index();
+        size_t q = self >= 0 && owner() == this
+            ? static_cast<size_t>(self)
+            : next_queue_.fetch_add(1) % queues_.size();
+        pending_.fetch_add(1);
+        {
+            // counted under the queue's lock, so that a `pop` or `steal` of
+            // this task cannot decrement `queued_` before it is incremented
+            std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+            queues_[q]->tasks.push_back(std::move(task));
+            queued_.fetch_add(1);
+        }
+        {
+            // a worker between its check of `queued_` and its wait holds
+            // `mutex_`, so it either sees the task or gets the notification
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        work_cv_.notify_one();
+    }
+
+    /** Block until all submitted tasks have finished. */
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return pending_.load() == 0; });
+        if (error_) {
+            std::exception_ptr e = error_;
+            error_ = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    static int& worker_index() {
+        thread_local int index = -1;
+        return index;
+    }
+
+    static ThreadPool *& owner() {
+        thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    bool pop(size_t i, Task& task) {
+        Queue& q = *queues_[i];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty())
+            return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(size_t i, Task& task) {
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            Queue& q = *queues_[(i + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty())
+                continue;
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            queued_.fetch_sub(1);
+            num_steals_.fetch_add(1);
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t i) {
+        worker_index() = static_cast<int>(i);
+        owner() = this;
+        Task task;
+        for (;;) {
+            if (pop(i, task) || steal(i, task)) {
+                try {
+                    task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!error_)
+                        error_ = std::current_exception();
+                }
+                task = nullptr;
+                if (pending_.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    done_cv_.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this]() { return stop_ || queued_.load() > 0; });
+            if (stop_ && queued_.load() == 0)
+                return;
+        }
+    }
+};
+
+} // namespace bdap
@@ -0,0 +1,85 @@
+#pragma once
+
+// After wyhash (final version 4) by Wang Yi, https://github.com/wangyi-fudan/wyhash
+// (public domain / The Unlicense): the 64-bit hash for little-endian 64-bit
+// platforms with the default secret, without the 32-bit and big-endian
+// variants.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace bdap {
+namespace wyhash_detail {
+
+inline void wymum(uint64_t *A, uint64_t *B) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  *A = _umul128(*A, *B, B);
+#else
+  __uint128_t r = *A;
+  r *= *B;
+  *A = (uint64_t)r;
+  *B = (uint64_t)(r >> 64);
+#endif
+}
+
+inline uint64_t wymix(uint64_t A, uint64_t B) { wymum(&A, &B); return A ^ B; }
+
+inline uint64_t wyr8(const uint8_t *p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+inline uint64_t wyr4(const uint8_t *p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline uint64_t wyr3(const uint8_t *p, size_t k)
+{ return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1]; }
+
+constexpr uint64_t wyp[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                             0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+} // namespace wyhash_detail
+
+inline uint64_t wyhash(const void *key, size_t len, uint64_t seed) {
+  using namespace wyhash_detail;
+  const uint64_t *secret = wyp;
+  const uint8_t *p = (const uint8_t *)key;
+  seed ^= wymix(seed ^ secret[0], secret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+      b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = wyr3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+        see1 = wymix(wyr8(p + 16) ^ secret[2], wyr8(p + 24) ^ see1);
+        see2 = wymix(wyr8(p + 32) ^ secret[3], wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyr8(p + i - 16);
+    b = wyr8(p + i - 8);
+  }
+  a ^= secret[1];
+  b ^= seed;
+  wymum(&a, &b);
+  return wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+} // namespace bdap
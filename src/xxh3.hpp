@@ -0,0 +1,261 @@
+#pragma once
+
+// After XXH3_64bits_withSeed of xxHash by Yann Collet,
+// https://github.com/Cyan4973/xxHash (BSD 2-Clause License): the scalar code
+// paths for little-endian 64-bit platforms, with the default secret.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace bdap {
+namespace xxh3_detail {
+
+constexpr uint32_t PRIME32_1 = 0x9E3779B1U;
+constexpr uint32_t PRIME32_2 = 0x85EBCA77U;
+constexpr uint32_t PRIME32_3 = 0xC2B2AE3DU;
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+constexpr size_t SECRET_SIZE = 192;
+constexpr size_t STRIPE_LEN = 64;
+constexpr size_t SECRET_CONSUME_RATE = 8;
+constexpr size_t ACC_NB = 8;
+constexpr size_t MIDSIZE_MAX = 240;
+constexpr size_t MIDSIZE_STARTOFFSET = 3;
+constexpr size_t MIDSIZE_LASTOFFSET = 17;
+constexpr size_t SECRET_SIZE_MIN = 136;
+constexpr size_t SECRET_LASTACC_START = 7;
+constexpr size_t SECRET_MERGEACCS_START = 11;
+
+alignas(64) constexpr uint8_t kSecret[SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+inline uint32_t read32(const uint8_t *p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline uint64_t read64(const uint8_t *p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+inline void write64(uint8_t *p, uint64_t v) { std::memcpy(p, &v, 8); }
+
+inline uint32_t swap32(uint32_t x) {
+    return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000)
+         | ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+}
+
+inline uint64_t swap64(uint64_t x) {
+    return ((x << 56) & 0xff00000000000000ULL) | ((x << 40) & 0x00ff000000000000ULL)
+         | ((x << 24) & 0x0000ff0000000000ULL) | ((x << 8) & 0x000000ff00000000ULL)
+         | ((x >> 8) & 0x00000000ff000000ULL) | ((x >> 24) & 0x0000000000ff0000ULL)
+         | ((x >> 40) & 0x000000000000ff00ULL) | ((x >> 56) & 0x00000000000000ffULL);
+}
+
+inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t mul128_fold64(uint64_t lhs, uint64_t rhs) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(lhs, rhs, &hi);
+    return lo ^ hi;
+#else
+    __uint128_t product = (__uint128_t)lhs * rhs;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#endif
+}
+
+inline uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= 0x9FB21C651E98DF25ULL;
+    h ^= (h >> 35) + len;
+    h *= 0x9FB21C651E98DF25ULL;
+    return h ^ (h >> 28);
+}
+
+inline uint64_t len_1to3(const uint8_t *input, size_t len, const uint8_t *secret,
+                         uint64_t seed) {
+    uint8_t c1 = input[0];
+    uint8_t c2 = input[len >> 1];
+    uint8_t c3 = input[len - 1];
+    uint32_t combined = ((uint32_t)c1 << 16) | ((uint32_t)c2 << 24)
+                      | ((uint32_t)c3 << 0) | ((uint32_t)len << 8);
+    uint64_t bitflip = (read32(secret) ^ read32(secret + 4)) + seed;
+    return xxh64_avalanche((uint64_t)combined ^ bitflip);
+}
+
+inline uint64_t len_4to8(const uint8_t *input, size_t len, const uint8_t *secret,
+                         uint64_t seed) {
+    seed ^= (uint64_t)swap32((uint32_t)seed) << 32;
+    uint32_t input1 = read32(input);
+    uint32_t input2 = read32(input + len - 4);
+    uint64_t bitflip = (read64(secret + 8) ^ read64(secret + 16)) - seed;
+    uint64_t input64 = input2 + ((uint64_t)input1 << 32);
+    return rrmxmx(input64 ^ bitflip, len);
+}
+
+inline uint64_t len_9to16(const uint8_t *input, size_t len, const uint8_t *secret,
+                          uint64_t seed) {
+    uint64_t bitflip1 = (read64(secret + 24) ^ read64(secret + 32)) + seed;
+    uint64_t bitflip2 = (read64(secret + 40) ^ read64(secret + 48)) - seed;
+    uint64_t input_lo = read64(input) ^ bitflip1;
+    uint64_t input_hi = read64(input + len - 8) ^ bitflip2;
+    uint64_t acc = len + swap64(input_lo) + input_hi + mul128_fold64(input_lo, input_hi);
+    return avalanche(acc);
+}
+
+inline uint64_t len_0to16(const uint8_t *input, size_t len, const uint8_t *secret,
+                          uint64_t seed) {
+    if (len > 8)
+        return len_9to16(input, len, secret, seed);
+    if (len >= 4)
+        return len_4to8(input, len, secret, seed);
+    if (len)
+        return len_1to3(input, len, secret, seed);
+    return xxh64_avalanche(seed ^ (read64(secret + 56) ^ read64(secret + 64)));
+}
+
+inline uint64_t mix16B(const uint8_t *input, const uint8_t *secret, uint64_t seed) {
+    uint64_t input_lo = read64(input);
+    uint64_t input_hi = read64(input + 8);
+    return mul128_fold64(input_lo ^ (read64(secret) + seed),
+                         input_hi ^ (read64(secret + 8) - seed));
+}
+
+inline uint64_t len_17to128(const uint8_t *input, size_t len, const uint8_t *secret,
+                            uint64_t seed) {
+    uint64_t acc = len * PRIME64_1;
+    if (len > 32) {
+        if (len > 64) {
+            if (len > 96) {
+                acc += mix16B(input + 48, secret + 96, seed);
+                acc += mix16B(input + len - 64, secret + 112, seed);
+            }
+            acc += mix16B(input + 32, secret + 64, seed);
+            acc += mix16B(input + len - 48, secret + 80, seed);
+        }
+        acc += mix16B(input + 16, secret + 32, seed);
+        acc += mix16B(input + len - 32, secret + 48, seed);
+    }
+    acc += mix16B(input + 0, secret + 0, seed);
+    acc += mix16B(input + len - 16, secret + 16, seed);
+    return avalanche(acc);
+}
+
+inline uint64_t len_129to240(const uint8_t *input, size_t len, const uint8_t *secret,
+                             uint64_t seed) {
+    uint64_t acc = len * PRIME64_1;
+    int nb_rounds = (int)len / 16;
+    for (int i = 0; i < 8; i++)
+        acc += mix16B(input + 16 * i, secret + 16 * i, seed);
+    acc = avalanche(acc);
+    for (int i = 8; i < nb_rounds; i++)
+        acc += mix16B(input + 16 * i, secret + 16 * (i - 8) + MIDSIZE_STARTOFFSET, seed);
+    acc += mix16B(input + len - 16, secret + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET, seed);
+    return avalanche(acc);
+}
+
+inline void accumulate_512(uint64_t *acc, const uint8_t *input, const uint8_t *secret) {
+    for (size_t i = 0; i < ACC_NB; i++) {
+        uint64_t data_val = read64(input + 8 * i);
+        uint64_t data_key = data_val ^ read64(secret + 8 * i);
+        acc[i ^ 1] += data_val;
+        acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+    }
+}
+
+inline void scramble_acc(uint64_t *acc, const uint8_t *secret) {
+    for (size_t i = 0; i < ACC_NB; i++) {
+        uint64_t acc64 = acc[i];
+        acc64 ^= acc64 >> 47;
+        acc64 ^= read64(secret + 8 * i);
+        acc64 *= PRIME32_1;
+        acc[i] = acc64;
+    }
+}
+
+inline void accumulate(uint64_t *acc, const uint8_t *input, const uint8_t *secret,
+                       size_t nb_stripes) {
+    for (size_t n = 0; n < nb_stripes; n++)
+        accumulate_512(acc, input + n * STRIPE_LEN, secret + n * SECRET_CONSUME_RATE);
+}
+
+inline uint64_t merge_accs(const uint64_t *acc, const uint8_t *secret, uint64_t start) {
+    uint64_t result = start;
+    for (size_t i = 0; i < 4; i++)
+        result += mul128_fold64(acc[2 * i] ^ read64(secret + 16 * i),
+                                acc[2 * i + 1] ^ read64(secret + 16 * i + 8));
+    return avalanche(result);
+}
+
+inline uint64_t hash_long(const uint8_t *input, size_t len, uint64_t seed) {
+    uint8_t custom[SECRET_SIZE];
+    const uint8_t *secret = kSecret;
+    if (seed != 0) {
+        for (size_t i = 0; i < SECRET_SIZE / 16; i++) {
+            write64(custom + 16 * i, read64(kSecret + 16 * i) + seed);
+            write64(custom + 16 * i + 8, read64(kSecret + 16 * i + 8) - seed);
+        }
+        secret = custom;
+    }
+    uint64_t acc[ACC_NB] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                            PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+    size_t nb_stripes_per_block = (SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+    size_t block_len = STRIPE_LEN * nb_stripes_per_block;
+    size_t nb_blocks = (len - 1) / block_len;
+    for (size_t n = 0; n < nb_blocks; n++) {
+        accumulate(acc, input + n * block_len, secret, nb_stripes_per_block);
+        scramble_acc(acc, secret + SECRET_SIZE - STRIPE_LEN);
+    }
+    size_t nb_stripes = ((len - 1) - (block_len * nb_blocks)) / STRIPE_LEN;
+    accumulate(acc, input + nb_blocks * block_len, secret, nb_stripes);
+    accumulate_512(acc, input + len - STRIPE_LEN,
+                   secret + SECRET_SIZE - STRIPE_LEN - SECRET_LASTACC_START);
+    return merge_accs(acc, secret + SECRET_MERGEACCS_START, len * PRIME64_1);
+}
+
+} // namespace xxh3_detail
+
+inline uint64_t XXH3_64bits_withSeed(const void *data, size_t len, uint64_t seed) {
+    using namespace xxh3_detail;
+    const uint8_t *input = (const uint8_t *)data;
+    if (len <= 16)
+        return len_0to16(input, len, kSecret, seed);
+    if (len <= 128)
+        return len_17to128(input, len, kSecret, seed);
+    if (len <= MIDSIZE_MAX)
+        return len_129to240(input, len, kSecret, seed);
+    return hash_long(input, len, seed);
+}
+
+} // namespace bdap